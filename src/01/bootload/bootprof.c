@@ -0,0 +1,70 @@
+#include "defines.h"
+#include "bootprof.h"
+
+/*
+ * 8ビットタイマのチャネル0,1をカスケード接続した16ビットのフリーランカウンタで
+ * 起動時間を計測する(φ/64 = 3.2マイクロ秒でカウント)
+ * OSに制御を渡した後もカウントを続けるので、OS側でも同じカウンタで記録できる
+ * カウンタは約210ミリ秒で一周するので、オーバーフローはチェックポイントの
+ * 記録時に検出して上位16ビットに数える。このためコマンド入力待ちのように
+ * チェックポイントの間隔が一周より長い区間は正しく計測できない
+ */
+
+#define H8_3069F_TMR8 ((volatile struct h8_3069f_tmr8 *)0xffff80)
+
+struct h8_3069f_tmr8 {
+  volatile uint8 tcr0;
+  volatile uint8 tcr1;
+  volatile uint8 tcsr0;
+  volatile uint8 tcsr1;
+  volatile uint8 tcora0;
+  volatile uint8 tcora1;
+  volatile uint8 tcorb0;
+  volatile uint8 tcorb1;
+  volatile uint16 tcnt; /* TCNT0(上位8ビット)と TCNT1(下位8ビット) */
+};
+
+#define H8_3069F_TMR8_TCR_CKS_STOP (0<<0)
+#define H8_3069F_TMR8_TCR_CKS_PER64 (2<<0)
+#define H8_3069F_TMR8_TCR_CKS_CASCADE (4<<0) /* 16ビットカウントモード(チャネル1のオーバーフローでカウント) */
+
+#define H8_3069F_TMR8_TCSR_OVF (1<<5)
+
+/* 計測の開始 */
+void bootprof_init(void) {
+  volatile struct h8_3069f_tmr8 *tmr = H8_3069F_TMR8;
+  volatile bootprof_t *bp = BOOTPROF;
+
+  tmr->tcr1 = H8_3069F_TMR8_TCR_CKS_STOP; /* カウント停止 */
+  tmr->tcr0 = H8_3069F_TMR8_TCR_CKS_CASCADE;
+  tmr->tcnt = 0;
+  tmr->tcsr0 &= ~H8_3069F_TMR8_TCSR_OVF; /* 1を読んでから0を書いてクリア */
+
+  bp->magic = BOOTPROF_MAGIC;
+  bp->num = 0;
+  bp->high = 0;
+
+  tmr->tcr1 = H8_3069F_TMR8_TCR_CKS_PER64; /* カウント開始 */
+}
+
+/* チェックポイントの記録 */
+void bootprof_mark(const char *name) {
+  volatile struct h8_3069f_tmr8 *tmr = H8_3069F_TMR8;
+  volatile bootprof_t *bp = BOOTPROF;
+  uint16 count;
+
+  if ((bp->magic != BOOTPROF_MAGIC) || (bp->num >= BOOTPROF_NUM)) {
+    return;
+  }
+
+  count = tmr->tcnt;
+  if (tmr->tcsr0 & H8_3069F_TMR8_TCSR_OVF) {
+    tmr->tcsr0 &= ~H8_3069F_TMR8_TCSR_OVF;
+    bp->high++;
+    count = tmr->tcnt; // オーバーフロー後の値を読み直す
+  }
+
+  bp->points[bp->num].name = name;
+  bp->points[bp->num].count = ((uint32)bp->high << 16) | count;
+  bp->num++;
+}
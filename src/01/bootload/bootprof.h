@@ -0,0 +1,33 @@
+#ifndef _BOOTPROF_H_INCLUDED_
+#define _BOOTPROF_H_INCLUDED_
+
+/*
+ * 起動時間の計測記録
+ * ブートローダとOSで共有するので、構造体の定義は os/bootprof.h と
+ * 一致させること(配置はリンカスクリプトの bootprof 領域)
+ */
+
+/* 以下はリンカスクリプトで定義してあるシンボル */
+extern char bootprof;
+#define BOOTPROF_ADDR (&bootprof)
+
+#define BOOTPROF_MAGIC 0x4250 // 記録が有効であることを示す値("BP")
+#define BOOTPROF_NUM 12 // 記録できるチェックポイントの数
+
+typedef struct {
+  uint16 magic;
+  uint16 num; // 記録したチェックポイントの数
+  uint16 high; // カウンタの上位16ビット(オーバーフローの回数)
+  uint16 dummy;
+  struct {
+    const char *name; // チェックポイント名(文字列はROMかOSのイメージ内に置くこと)
+    uint32 count; // 計測開始からのカウント数
+  } points[BOOTPROF_NUM];
+} bootprof_t;
+
+#define BOOTPROF ((volatile bootprof_t *)BOOTPROF_ADDR)
+
+void bootprof_init(void); /* 計測の開始(タイマの起動と記録の初期化) */
+void bootprof_mark(const char *name); /* チェックポイントの記録 */
+
+#endif
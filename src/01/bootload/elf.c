@@ -60,20 +60,43 @@ static int elf_check(struct elf_header *header) {
     return 0;
 }
 
+#define ELF_PHDR_MAX 8 // 扱えるプログラムヘッダの個数
+
+/*
+ * 受信バッファはロード先のRAMと重なっている(ld.scr を参照)ので、セグメントの
+ * コピーでバッファ中のヘッダが書き換えられる前に、プログラムヘッダを退避しておく。
+ * ロード先はファイル中の位置より前にあるので、先頭から順にコピーすれば
+ * まだコピーしていない部分を壊すことはない(後ろにある場合はエラーにする)
+ */
 static int elf_load_program(struct elf_header *header) {
-    int i;
+    static struct elf_program_header phdrs[ELF_PHDR_MAX];
     struct elf_program_header *phdr;
+    char *src, *dst;
+    int i, num;
+
+    num = header->program_header_num;
+    if (num > ELF_PHDR_MAX) return -1;
 
-    for (i = 0; i < header->program_header_num; i++) {
+    for (i = 0; i < num; i++) {
       /* プログラムヘッダを取得 */
       phdr = (struct elf_program_header *)((char *)header +
                                             header->program_header_offset +
                                             header->program_header_size * i);
+      memcpy(&phdrs[i], phdr, sizeof(phdrs[i]));
+    }
 
+    for (i = 0, phdr = phdrs; i < num; i++, phdr++) {
       if (phdr->type != 1) continue; // ロード可能なセグメントか？
 
-      memcpy((char *)phdr->physical_addr, (char *)header + phdr->offset,
-        phdr->file_size);
+      src = (char *)header + phdr->offset;
+      dst = (char *)phdr->physical_addr;
+      if ((dst > src) && (dst < src + phdr->file_size)) return -1;
+      memcpy(dst, src, phdr->file_size);
+    }
+
+    /* BSSのゼロクリアは、後続のセグメントを壊さないようにコピーの後で行う */
+    for (i = 0, phdr = phdrs; i < num; i++, phdr++) {
+      if (phdr->type != 1) continue;
       memset((char *)phdr->physical_addr + phdr->file_size, 0,
         phdr->memory_size - phdr->file_size);
     }
@@ -83,9 +106,11 @@ static int elf_load_program(struct elf_header *header) {
 
 char *elf_load(char *buf) {
   struct elf_header *header = (struct elf_header *)buf;
+  char *entry_point;
 
   if (elf_check(header) < 0) return NULL;
+  entry_point = (char *)header->entry_point; // ロードでヘッダが書き換えられる前に取得する
   if (elf_load_program(header) < 0) return NULL;
 
-  return (char *)header->entry_point;
+  return entry_point;
 }
@@ -4,11 +4,15 @@
 #include "xmodem.h"
 #include "elf.h"
 #include "lib.h"
+#include "bootprof.h"
 
 static int init(void) {
   /* 以下はリンカスクリプトで定義してあるシンボル */
   extern int erodata, data_start, edata, bss_start, ebss; // リンカスクリプトで定義されたシンボルを参照可能にする
 
+  /* 起動時間の計測開始(以降のチェックポイントはこの時点からのカウント数になる) */
+  bootprof_init();
+
   /*
   * データ領域と BSS 領域を初期化する。この処理以降でないと、
   * グローバル変数が初期化されていないので注意。
@@ -22,6 +26,8 @@ static int init(void) {
   /* シリアルの初期化 */
   serial_init(SERIAL_DEFAULT_DEVICE);
 
+  bootprof_mark("kzload init");
+
   return 0;
 }
 
@@ -89,7 +95,9 @@ int main(void) {
       puts("\n");
       dump(loadbuf, size);
     } else if (!strcmp(buf, "run")) {
+      bootprof_mark("kzload run");
       entry_point = elf_load(loadbuf); // メモリ上に展開(ロード)
+      bootprof_mark("elf_load");
       if (!entry_point) {
         puts("run error!\n");
       } else {
@@ -4,6 +4,7 @@ extern void start(void);
 extern void intr_softerr(void);
 extern void intr_syscall(void);
 extern void intr_serintr(void);
+extern void intr_timintr(void);
 
 /*
  * 割り込みベクタの設定
@@ -13,7 +14,7 @@ void (*vectors[]) (void) = {
   start, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
   intr_syscall, intr_softerr, intr_softerr, intr_softerr,
   NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+  NULL, NULL, NULL, NULL, intr_timintr, NULL, NULL, NULL, /* IMIA0 */
   NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
   NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
   NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
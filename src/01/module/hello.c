@@ -0,0 +1,33 @@
+#include "defines.h"
+#include "kozos.h"
+#include "consdrv.h"
+#include "lib.h"
+#include "module.h"
+
+/*
+ * アプリケーションモジュールのサンプル
+ * コンソールに文字列を出力して終了する
+ */
+
+static int hello_main(int argc, char *argv[]) {
+  static char msg[] = "hello from module!\n";
+  char *p;
+  int len;
+
+  len = strlen(msg);
+  p = kz_kmalloc(len + 2);
+  if (p == NULL) {
+    return -1;
+  }
+  p[0] = '0';
+  p[1] = CONSDRV_CMD_WRITE;
+  memcpy(&p[2], msg, len);
+  if (kz_send(MSGBOX_ID_CONSOUTPUT, len + 2, p) < 0) {
+    kz_kmfree(p); // 送信できなかった場合は、受信側で解放されない
+    return -1;
+  }
+
+  return 0;
+}
+
+KZ_MODULE("hello", hello_main, 8, 0x100);
@@ -0,0 +1,69 @@
+#include "defines.h"
+#include "bootprof.h"
+
+#if KZ_CONFIG_USE_BOOTPROF
+
+/*
+ * 起動時間の計測
+ * ブートローダが起動した8ビットタイマ(チャネル0,1のカスケード接続)の
+ * フリーランカウンタを読んで、ブートローダの記録に続けてチェックポイントを
+ * 追加する。ブートローダを経由せずに起動した場合など、記録が有効でなければ
+ * 何もしない
+ */
+
+#define H8_3069F_TMR8 ((volatile struct h8_3069f_tmr8 *)0xffff80)
+
+struct h8_3069f_tmr8 {
+  volatile uint8 tcr0;
+  volatile uint8 tcr1;
+  volatile uint8 tcsr0;
+  volatile uint8 tcsr1;
+  volatile uint8 tcora0;
+  volatile uint8 tcora1;
+  volatile uint8 tcorb0;
+  volatile uint8 tcorb1;
+  volatile uint16 tcnt; /* TCNT0(上位8ビット)と TCNT1(下位8ビット) */
+};
+
+#define H8_3069F_TMR8_TCSR_OVF (1<<5)
+
+/* チェックポイントの記録 */
+void bootprof_mark(const char *name) {
+  volatile struct h8_3069f_tmr8 *tmr = H8_3069F_TMR8;
+  volatile bootprof_t *bp = BOOTPROF;
+  uint16 count;
+
+  if ((bp->magic != BOOTPROF_MAGIC) || (bp->num >= BOOTPROF_NUM)) {
+    return;
+  }
+
+  count = tmr->tcnt;
+  if (tmr->tcsr0 & H8_3069F_TMR8_TCSR_OVF) {
+    tmr->tcsr0 &= ~H8_3069F_TMR8_TCSR_OVF;
+    bp->high++;
+    count = tmr->tcnt; // オーバーフロー後の値を読み直す
+  }
+
+  bp->points[bp->num].name = name;
+  bp->points[bp->num].count = ((uint32)bp->high << 16) | count;
+  bp->num++;
+}
+
+/* チェックポイントの取得(記録がなければ-1を返す) */
+int bootprof_get(int index, const char **namep, uint32 *countp) {
+  volatile bootprof_t *bp = BOOTPROF;
+
+  if ((bp->magic != BOOTPROF_MAGIC) || (index < 0) || (index >= bp->num)) {
+    return -1;
+  }
+  *namep = bp->points[index].name;
+  *countp = bp->points[index].count;
+  return 0;
+}
+
+/* 計測の終了 */
+void bootprof_close(void) {
+  BOOTPROF->magic = 0;
+}
+
+#endif
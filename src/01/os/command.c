@@ -2,50 +2,358 @@
 #include "kozos.h"
 #include "consdrv.h"
 #include "lib.h"
+#include "bootprof.h"
+#include "module.h"
 
 /* コンソールドライバの使用開始をコンソールドライバに依頼する */
 static void send_use(int index) {
   char *p;
   p = kz_kmalloc(3);
+  if (p == NULL) {
+    return;
+  }
   p[0] = '0';
   p[1] = CONSDRV_CMD_USE;
   p[2] = '0' + index;
-  kz_send(MSGBOX_ID_CONSOUTPUT, 3, p);
+  if (kz_send(MSGBOX_ID_CONSOUTPUT, 3, p) < 0) {
+    kz_kmfree(p); // 送信できなければ所有権は移らない
+  }
 }
 
-/* コンソールへの文字列出力をコンソールドライバに依頼する */
-static void send_write(char *str) {
+/* コンソールへの文字列出力の依頼(要求部分) */
+static char write_header[] = { '0', CONSDRV_CMD_WRITE };
+
+/* コンソールへの文字列出力を、文字列をコピーしてから依頼する(一時的な文字列用) */
+static void send_copy(char *str) {
   char *p;
   int len;
   len = strlen(str);
   p = kz_kmalloc(len + 2);
-  p[0] = '0';
-  p[1] = CONSDRV_CMD_WRITE;
+  if (p == NULL) {
+    return; // 領域を獲得できなければ出力しない
+  }
+  memcpy(p, write_header, sizeof(write_header));
   memcpy(&p[2], str, len);
-  kz_send(MSGBOX_ID_CONSOUTPUT, len + 2, p);
+  if (kz_send(MSGBOX_ID_CONSOUTPUT, len + 2, p) < 0) {
+    kz_kmfree(p);
+  }
 }
 
-int command_main(int argc, char *argv[]) {
+/*
+ * コンソールへの文字列出力をコンソールドライバに依頼する
+ * 要求と文字列を別々のセグメントとして送信するので、コピーは発生しない。
+ * 文字列は出力されるまで書き換えられないもの(文字列リテラルなど)に限る
+ */
+static void send_write(char *str) {
+#if KZ_CONFIG_USE_SENDV
+  kz_iovec_t iov[2];
+  iov[0].p = write_header;
+  iov[0].size = sizeof(write_header);
+  iov[1].p = str;
+  iov[1].size = strlen(str);
+  kz_sendv(MSGBOX_ID_CONSOUTPUT, iov, 2);
+#else
+  send_copy(str); // セグメントの送信を使わない構成ではコピーする
+#endif
+}
+
+/* 数値を16進でコンソールに出力する(桁数を先に求めて、メッセージの領域に直接書き込む) */
+static void send_xval(unsigned long value, int column) {
+  unsigned long v;
+  char *msg, *p;
+  int len;
+
+  for (len = 0, v = value; v; v >>= 4) {
+    len++;
+  }
+  if (len < column) {
+    len = column;
+  }
+  if (!len) {
+    len++;
+  }
+
+  msg = kz_kmalloc(len + 2);
+  if (msg == NULL) {
+    return;
+  }
+  memcpy(msg, write_header, sizeof(write_header));
+  for (p = msg + len + 1; p > msg + 1; p--) {
+    *p = "0123456789abcdef"[value & 0xf];
+    value >>= 4;
+  }
+  if (kz_send(MSGBOX_ID_CONSOUTPUT, len + 2, msg) < 0) {
+    kz_kmfree(msg);
+  }
+}
+
+/* カーネル情報ブロックの内容を表示する(システムコールを使わずに読める) */
+static void print_kinfo(void) {
+  send_write("ticks:"); send_xval(kz_kinfo->ticks, 0);
+  send_write(" dispatches:"); send_xval(kz_kinfo->dispatches, 0);
+  send_write(" syscalls:"); send_xval(kz_kinfo->syscalls, 0);
+  send_write(" intrs:"); send_xval(kz_kinfo->intrs, 0);
+  send_write("\n");
+  send_write("mem used:"); send_xval(kz_kinfo->mem.used, 0);
+  send_write(" peak:"); send_xval(kz_kinfo->mem.peak, 0);
+  send_write(" allocs:"); send_xval(kz_kinfo->mem.allocs, 0);
+  send_write(" spills:"); send_xval(kz_kinfo->mem.spills, 0);
+  send_write(" fails:"); send_xval(kz_kinfo->mem.fails, 0);
+  send_write("\n");
+}
+
+#if KZ_CONFIG_USE_STATISTICS
+/* メッセージボックスごとの統計情報を表示する(滞留しているメッセージボックスを探す) */
+static void print_msgboxes(void) {
+  kz_msgbox_stat_t stat;
+  int i, j, ret;
+
+  for (i = 0; (ret = kz_msgbox_stat(i, &stat)) >= 0; i++) {
+    if (!ret) {
+      continue;
+    }
+    send_xval(stat.id, 4);
+    send_write(" depth:"); send_xval(stat.depth, 0);
+    send_write(" peak:"); send_xval(stat.peak, 0);
+    send_write(" total:"); send_xval(stat.total, 0);
+    send_write(" waits:"); send_xval(stat.waits, 0);
+    send_write(" wait:"); send_xval(stat.wait_total, 0);
+    send_write(" max:"); send_xval(stat.wait_max, 0);
+    send_write("\n lat:");
+    for (j = 0; j < MSGBOX_LATENCY_NUM; j++) {
+      send_write(" "); send_xval(stat.latency[j], 0);
+    }
+    send_write("\n");
+  }
+}
+
+#if KZ_CONFIG_USE_WORKPOOL
+/* ワーカスレッドプールの統計情報を表示する */
+static void print_jobstat(void) {
+  kz_jobstat_t stat;
+
+  kz_job_stat(&stat);
+  send_write("workers:"); send_xval(stat.workers, 0);
+  send_write(" idle:"); send_xval(stat.idle, 0);
+  send_write(" queued:"); send_xval(stat.queued, 0);
+  send_write(" peak:"); send_xval(stat.peak, 0);
+  send_write(" posted:"); send_xval(stat.posted, 0);
+  send_write(" done:"); send_xval(stat.done, 0);
+  send_write("\n");
+}
+#endif
+
+/* スレッドの一覧を表示する(周期スレッドはジッタとオーバーランも表示する) */
+static void print_threads(void) {
+  kz_thread_stat_t stat;
+  int i;
+
+  for (i = 0; kz_thread_stat(i, &stat) >= 0; i++) {
+    if (!stat.id) {
+      continue;
+    }
+    send_xval(stat.id, 8);
+    send_write(" ");
+    send_copy(stat.name);
+    send_write(" pri:"); send_xval(stat.priority, 0);
+    if (stat.period) {
+      send_write(" period:"); send_xval(stat.period, 0);
+      send_write(" rel:"); send_xval(stat.releases, 0);
+      send_write(" ovr:"); send_xval(stat.overruns, 0);
+      send_write(" jit:"); send_xval(stat.jitter, 0);
+      send_write(" max:"); send_xval(stat.jitter_max, 0);
+    }
+    if (stat.budget) {
+      send_write(" budget:"); send_xval(stat.budget, 0);
+      send_write(" used:"); send_xval(stat.used, 0);
+      send_write(" exh:"); send_xval(stat.exhausted, 0);
+    }
+    send_write("\n");
+  }
+}
+#endif
+
+#if KZ_CONFIG_USE_BOOTPROF
+/*
+ * 起動時間の内訳を表示する
+ * (ブートローダの計測開始からのカウント数と、直前のチェックポイントからの差分)
+ */
+static void print_bootprof(void) {
+  const char *name;
+  uint32 count, prev = 0;
+  int i;
+
+  for (i = 0; bootprof_get(i, &name, &count) >= 0; i++) {
+    if (i == 0) {
+      send_write("boot profile (1 count = 3.2us)\n");
+    }
+    send_xval(count, 8);
+    send_write(" +");
+    send_xval(count - prev, 8);
+    send_write(" ");
+    send_write((char *)name);
+    send_write("\n");
+    prev = count;
+  }
+
+  bootprof_close(); // 表示は起動時の1回のみ
+}
+#endif
+
+#if KZ_CONFIG_USE_BENCH
+#define BENCH_COUNT 256 // 送受信するメッセージの数
+#define BENCH_BURST 4 // まとめて送信してから受信するメッセージの数(スロット数以下にする)
+
+/* メッセージボックスの送受信の時間を計測する(マイクロ秒) */
+static uint32 bench_msgbox(kz_msgbox_id_t id) {
+  uint32 start;
+  int i, j, size;
   char *p;
+
+  start = kz_gettime();
+  for (i = 0; i < BENCH_COUNT / BENCH_BURST; i++) {
+    for (j = 0; j < BENCH_BURST; j++) {
+      kz_send(id, 0, NULL);
+    }
+    for (j = 0; j < BENCH_BURST; j++) {
+      kz_recv(id, &size, &p);
+    }
+  }
+  return kz_gettime() - start;
+}
+
+/* ベンチマーク(スロットを持つメッセージボックスと、持たないものを比較する) */
+static void bench(void) {
+  uint32 slot, list;
+
+  slot = bench_msgbox(MSGBOX_ID_BENCHSLOT);
+  list = bench_msgbox(MSGBOX_ID_BENCHLIST);
+
+  send_write("msgbox send/recv x"); send_xval(BENCH_COUNT, 0);
+  send_write(" slot:"); send_xval(slot, 0);
+  send_write("us list:"); send_xval(list, 0);
+  send_write("us\n");
+}
+#endif
+
+#if KZ_CONFIG_USE_MODULE
+/* アプリケーションモジュールを XMODEM で受信して起動する */
+static void load_module(void) {
+  switch (module_load()) {
+    case 0:
+      send_write("module started.\n");
+      break;
+    case MODULE_ERR_BUSY:
+      send_write("module is running.\n");
+      break;
+    case MODULE_ERR_RECV:
+      send_write("XMODEM receive error!\n");
+      break;
+    case MODULE_ERR_INVALID:
+      send_write("invalid module.\n");
+      break;
+    default:
+      send_write("module run error!\n");
+      break;
+  }
+}
+#endif
+
+/* プロンプトの出力と入力の待ち合わせを一括発行するか(使うシステムコールがすべてある構成のみ) */
+#define COMMAND_USE_BATCH (KZ_CONFIG_USE_BATCH && KZ_CONFIG_USE_SENDV && KZ_CONFIG_USE_RING)
+
+int command_main(int argc, char *argv[]) {
+#if COMMAND_USE_BATCH
+  static kz_batch_t ops[2];
+  static kz_iovec_t prompt[2] = {
+    { write_header, sizeof(write_header) },
+    { "command> ", 9 },
+  };
+#endif
+#if !KZ_CONFIG_USE_RING
+  char *msg;
+#endif
+  char p[32];
   int size;
 
   send_use(SERIAL_DEFAULT_DEVICE);
+#if KZ_CONFIG_USE_BOOTPROF
+  print_bootprof();
+#endif
+
+#if COMMAND_USE_BATCH
+  /*
+   * プロンプトの出力と、コンソールからの入力の待ち合わせを、
+   * 1回のシステムコールでまとめて行う
+   */
+  ops[0].type = KZ_SYSCALL_TYPE_SENDV;
+  ops[0].param.un.sendv.id = MSGBOX_ID_CONSOUTPUT;
+  ops[0].param.un.sendv.iovcnt = 2;
+  ops[1].type = KZ_SYSCALL_TYPE_RINGWAIT;
+  ops[1].param.un.ringwait.id = RING_ID_CONSINPUT;
+  ops[1].param.un.ringwait.want = 1;
+#endif
 
   while (1) {
+#if COMMAND_USE_BATCH
+    /*
+     * kz_sendv() はパラメータ領域の配列を、カーネルでコピーした配列(送信先が
+     * 解放する)に差し替えるので、発行のたびに設定し直す
+     */
+    ops[0].param.un.sendv.iov = prompt;
+    if (kz_batch(ops, 2) < 2) {
+      /*
+       * 出力が一杯でプロンプトの送信待ちになった場合は、そこで一括発行が
+       * 止まり、入力の待ち合わせは行われていないので、改めて待つ
+       */
+      kz_ring_wait(RING_ID_CONSINPUT, 1);
+    }
+#else
     send_write("command> ");
-
-    /* コンソールからの受信文字列を受け取る */
-    kz_recv(MSGBOX_ID_CONSINPUT, &size, &p);
+#endif
+#if KZ_CONFIG_USE_RING
+    /* 1行分のレコードを読み出す(データが揃っていれば、システムコールは発行しない) */
+    size = kz_ring_read(RING_ID_CONSINPUT, p, sizeof(p) - 1);
+    if (size < 0) {
+      continue;
+    }
+#else
+    /* 1行分のメッセージを受信して、ローカルのバッファにコピーする */
+    kz_recv(MSGBOX_ID_CONSINPUT, &size, &msg);
+    if (size > sizeof(p) - 1) {
+      size = sizeof(p) - 1;
+    }
+    memcpy(p, msg, size);
+    kz_kmfree(msg);
+#endif
     p[size] = '\0';
 
     if (!strncmp(p, "echo", 4)) {
-      send_write(p + 4);
+      send_copy(p + 4);
       send_write("\n");
+    } else if (!strncmp(p, "info", 4)) {
+      print_kinfo();
+#if KZ_CONFIG_USE_BENCH
+    } else if (!strncmp(p, "bench", 5)) {
+      bench();
+#endif
+#if KZ_CONFIG_USE_MODULE
+    } else if (!strncmp(p, "load", 4)) {
+      load_module();
+#endif
+#if KZ_CONFIG_USE_STATISTICS
+    } else if (!strncmp(p, "ps", 2)) {
+      print_threads();
+    } else if (!strncmp(p, "mbox", 4)) {
+      print_msgboxes();
+#if KZ_CONFIG_USE_WORKPOOL
+    } else if (!strncmp(p, "jobs", 4)) {
+      print_jobstat();
+#endif
+#endif
     } else {
       send_write("unkonwn .\n");
     }
-
-    kz_kmfree(p);
   }
 
   return 0;
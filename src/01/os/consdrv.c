@@ -16,10 +16,13 @@ static struct consreg {
   char *recv_buf; // 受信バッファ
   int send_len; // 送信バッファ中のデータサイズ
   int recv_len; // 受信バッファ中のデータサイズ
+  int send_wait; // 送信バッファの空きを待ってスリープしているなら0以外
 
-  long dummy[3];
+  int dummy[5];
 } consreg[CONSDRV_DEVICE_NUM]; // 複数のコンソールを管理可能にするために、配列にする
 
+static kz_thread_id_t consdrv_id; // コンソールドライバのスレッド(送信バッファの空き待ちから起床させる)
+
 /*
 * 以下の2つの関数(send_char(), send_string())は割込み処理とスレッドから
 * 呼ばれるが送信バッファを操作しており再入不可のため、スレッドから呼び出す
@@ -37,10 +40,16 @@ static void send_char(struct consreg *cons) {
   }
 }
 
-/* 文字列を送信バッファに書き込み送信開始する */
-static void send_string(struct consreg *cons, char *str, int len) {
+/*
+ * 文字列を送信バッファに書き込み送信開始する
+ * 送信バッファに入りきらない分は書き込まず、書き込めた文字数を返す
+ */
+static int send_string(struct consreg *cons, char *str, int len) {
   int i;
   for (i = 0; i < len; i++) { /* 文字列を送信バッファにコピー */
+    if (cons->send_len + ((str[i] == '\n') ? 2 : 1) > CONS_BUFFER_SIZE) {
+      break; // 送信バッファが一杯
+    }
     if (str[i] == '\n') { // 改行文字変換
       cons->send_buf[cons->send_len++] = '\r';
     }
@@ -55,6 +64,24 @@ static void send_string(struct consreg *cons, char *str, int len) {
     serial_intr_send_enable(cons->index);
     send_char(cons);
   }
+
+  return i;
+}
+
+/*
+ * スレッドから文字列を出力する(割込み禁止状態で呼ぶこと)
+ * 送信バッファが一杯になったら、送信割込みで空くまでスリープする。
+ * 割込み禁止のままスリープするので起床の取りこぼしはなく、起床後も
+ * 割込み禁止状態で戻る
+ */
+static void write_string(struct consreg *cons, char *str, int len) {
+  int n;
+  while ((n = send_string(cons, str, len)) < len) {
+    str += n;
+    len -= n;
+    cons->send_wait = 1;
+    kz_sleep();
+  }
 }
 
 /*
@@ -69,7 +96,10 @@ static void send_string(struct consreg *cons, char *str, int len) {
 */
 static int consdrv_intrproc(struct consreg *cons) {
   unsigned char c;
+#if !KZ_CONFIG_USE_RING
   char *p;
+#endif
+  int woken = 0;
 
   if (serial_is_recv_enable(cons->index)) {
     c = serial_recv_byte(cons->index);
@@ -81,17 +111,37 @@ static int consdrv_intrproc(struct consreg *cons) {
 
     if (cons->id) {
       if (c != '\n') {
-        /* 改行でないなら、受信バッファにバッファリングする */
-        cons->recv_buf[cons->recv_len++] = c; // 改行までを受信バッファに保存する
+        /* 改行でないなら、受信バッファにバッファリングする(一杯なら捨てる) */
+        if (cons->recv_len < CONS_BUFFER_SIZE) {
+          cons->recv_buf[cons->recv_len++] = c; // 改行までを受信バッファに保存する
+        }
       } else {
+#if KZ_CONFIG_USE_RING
+        /*
+         * Enterが押されたら、バッファの内容を1レコードとしてリングバッファに
+         * 書き込み、コマンド処理スレッドに渡す(メモリの獲得は不要)
+         * (割込みハンドラなので、サービスコールを利用する)
+        */
+        if (kx_ring_write(RING_ID_CONSINPUT, cons->recv_len, cons->recv_buf) >= 0) {
+          woken = 1; // 受信待ちのスレッドがレディー状態になりうる
+        }
+        // 書き込めない場合は、コマンド処理スレッドが読み出しきれていないので入力を捨てる
+#else
         /*
-         * Enterが押されたら、バッファの内容を
+         * Enterが押されたら、バッファの内容をコピーして
          * コマンド処理スレッドに通知する
          * (割込みハンドラなので、サービスコールを利用する)
         */
-        p = kx_kmalloc(CONS_BUFFER_SIZE);
-        memcpy(p, cons->recv_buf, cons->recv_len);
-        kx_send(MSGBOX_ID_CONSINPUT, cons->recv_len, p);
+        p = kx_kmalloc(cons->recv_len);
+        if (p != NULL) {
+          memcpy(p, cons->recv_buf, cons->recv_len);
+          if (kx_send(MSGBOX_ID_CONSINPUT, cons->recv_len, p) < 0) {
+            // コマンド処理スレッドが受け取りきれていないので、入力を捨てる
+            kx_kmfree(p);
+          }
+          woken = 1; // 受信待ちのスレッドがレディー状態になりうる
+        }
+#endif
         cons->recv_len = 0;
       }
     }
@@ -105,14 +155,26 @@ static int consdrv_intrproc(struct consreg *cons) {
       // 送信データがあるならば、引き続き送信する
       send_char(cons);
     }
+
+    /* 送信バッファの半分が空いたら、空きを待っているコンソールドライバを起床させる */
+    if (cons->send_wait && (cons->send_len <= CONS_BUFFER_SIZE / 2)) {
+      cons->send_wait = 0;
+      kx_wakeup(consdrv_id);
+      woken = 1;
+    }
   }
 
-  return 0;
+  return woken;
 }
 
-/* 割込みハンドラ */
-static void consdrv_intr(void) {
-  int i;
+/*
+ * 割込みハンドラ
+ * 1文字ごとの送信割込みではスレッドの状態は変化しないので、高速割込み
+ * ハンドラとして登録し、メッセージを送信した場合のみ0以外を返すことで
+ * 不要なスケジューリングとディスパッチを省略する
+ */
+static int consdrv_intr(void) {
+  int i, woken = 0;
   struct consreg *cons;
 
   for (i = 0; i < CONSDRV_DEVICE_NUM; i++) {
@@ -121,10 +183,12 @@ static void consdrv_intr(void) {
       if (serial_is_send_enable(cons->index) ||
           serial_is_recv_enable(cons->index)) {
           // 割込みがあるならば、割込み処理を呼び出す
-          consdrv_intrproc(cons);
+          woken |= consdrv_intrproc(cons);
         }
     }
   }
+
+  return woken;
 }
 
 static int consdrv_init(void) {
@@ -132,26 +196,50 @@ static int consdrv_init(void) {
   return 0;
 }
 
-/* スレッドからの要求を処理する */
-static int consdrv_command(struct consreg *cons, kz_thread_id_t id, int index, int size, char *command) {
+/*
+ * スレッドからの要求を処理する
+ * 要求は先頭のセグメントにあり、出力する文字列は後続のセグメントに続いてもよい
+ */
+static int consdrv_command(struct consreg *cons, kz_thread_id_t id, int index, kz_iovec_t *iov, int num) {
+  char *command = iov[0].p + 1;
+  int size = iov[0].size - 1;
+  int i;
+
   switch (command[0]) {
     case CONSDRV_CMD_USE:
-      cons->id = id;
-      cons->index = command[1] - '0';
       cons->send_buf = kz_kmalloc(CONS_BUFFER_SIZE);
       cons->recv_buf = kz_kmalloc(CONS_BUFFER_SIZE);
+      if (!cons->send_buf || !cons->recv_buf) {
+        /* バッファを獲得できなければ使用を開始しない(id は 0 のまま) */
+        if (cons->send_buf) {
+          kz_kmfree(cons->send_buf);
+        }
+        if (cons->recv_buf) {
+          kz_kmfree(cons->recv_buf);
+        }
+        cons->send_buf = cons->recv_buf = NULL;
+        break;
+      }
+      cons->id = id;
+      cons->index = command[1] - '0';
       cons->send_len = 0;
       cons->recv_len = 0;
       serial_init(cons->index);
       serial_intr_recv_enable(cons->index);
       break;
     case CONSDRV_CMD_WRITE:
+      if (!cons->id) {
+        break; // 使用を開始していない
+      }
       /*
        * send_string() では送信バッファを操作しており再入不可なので、
        * 排他のために割込み禁止にして呼び出す
       */
       INTR_DISABLE;
-      send_string(cons, command + 1, size - 1);
+      write_string(cons, command + 1, size - 1);
+      for (i = 1; i < num; i++) {
+        write_string(cons, iov[i].p, iov[i].size);
+      }
       INTR_ENABLE;
       break;
     default:
@@ -162,17 +250,26 @@ static int consdrv_command(struct consreg *cons, kz_thread_id_t id, int index, i
 }
 
 int consdrv_main(int argc, char *argv[]) {
-  int size, index;
+  kz_iovec_t iov[KZ_CONFIG_IOV_MAX];
+  int num, index;
   kz_thread_id_t id;
   char *p;
   
   consdrv_init();
-  kz_setintr(SOFTVEC_TYPE_SERINTR, consdrv_intr);
+  consdrv_id = kz_getid();
+  kz_setintr_fast(SOFTVEC_TYPE_SERINTR, consdrv_intr);
 
   while (1) {
-    id = kz_recv(MSGBOX_ID_CONSOUTPUT, &size, &p);
-    index = p[0] - '0';
-    consdrv_command(&consreg[index], id, index, size - 1, p + 1);
+#if KZ_CONFIG_USE_SENDV
+    id = kz_recvv(MSGBOX_ID_CONSOUTPUT, iov, &num, &p);
+#else
+    /* 要求と文字列は1つのメッセージなので、1つのセグメントとして扱う */
+    id = kz_recv(MSGBOX_ID_CONSOUTPUT, &iov[0].size, &p);
+    iov[0].p = p;
+    num = 1;
+#endif
+    index = iov[0].p[0] - '0';
+    consdrv_command(&consreg[index], id, index, iov, num);
     kz_kmfree(p);
   }
 
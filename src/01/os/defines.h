@@ -1,8 +1,11 @@
 #ifndef _DEFINES_H_INCLUDED_
 #define _DEFINES_H_INCLUDED_
 
+#include "kozos_config.h"
+
 #define NULL ((void *)0) // NULL ポインタの定義
 #define SERIAL_DEFAULT_DEVICE 1 // 標準のシリアルデバイス
+#define THREAD_NAME_SIZE 15 // スレッド名の最大長
 
 typedef unsigned char uint8;
 typedef unsigned short uint16;
@@ -11,11 +14,124 @@ typedef unsigned long uint32;
 typedef uint32 kz_thread_id_t; // スレッドID
 typedef int (*kz_func_t)(int argc, char *argv[]); // スレッドのメイン関数の型
 typedef void (*kz_handler_t)(void); // 割り込みハンドラの型
+typedef int (*kz_fasthandler_t)(void); // 高速割込みハンドラの型(レディー状態のスレッドを変化させた場合は0以外を返す)
+typedef int (*kz_job_func_t)(void *arg); // ワーカスレッドで実行するジョブの関数の型
+typedef uint32 kz_timer_id_t; // ソフトウェアタイマID
+typedef int kz_topic_id_t; // トピックID
+typedef int kz_pipe_id_t; // パイプID
+typedef void (*kz_timer_func_t)(void *arg); // ソフトウェアタイマのコールバック関数の型
 
-typedef enum {
-  MSGBOX_ID_CONSINPUT = 0,
-  MSGBOX_ID_CONSOUTPUT,
+/*
+ * メッセージボックスID
+ * 下位8ビットがメッセージボックスの番号、その上が世代番号になっている。
+ * 以下の静的なメッセージボックスは世代番号が0なので、番号がそのままIDになる
+ * (動的なメッセージボックスは kz_msgbox_create() で作成する)
+ */
+typedef int kz_msgbox_id_t;
+
+enum {
+  MSGBOX_ID_CONSOUTPUT = 0,
+#if !KZ_CONFIG_USE_RING
+  MSGBOX_ID_CONSINPUT, // コンソールからの入力(リングバッファを使わない構成)
+#endif
+#if KZ_CONFIG_USE_BENCH
+  MSGBOX_ID_BENCHSLOT, // ベンチマーク用(スロットあり)
+  MSGBOX_ID_BENCHLIST, // ベンチマーク用(スロットなし)
+#endif
   MSGBOX_ID_NUM
-} kz_msgbox_id_t;
+};
+
+#define MSGBOX_ID_NONE ((kz_msgbox_id_t)-1) // メッセージボックスの指定なし
+
+/* リングバッファID(割込み処理からスレッドへのデータの受け渡しに使う) */
+typedef enum {
+  RING_ID_CONSINPUT = 0, // コンソールからの入力(1行を1レコードとする)
+  RING_ID_NUM
+} kz_ring_id_t;
+
+/* メッセージの優先度(値が小さいほど優先度が高い。kz_send() は MSG_PRIORITY_NORMAL) */
+#define MSG_PRIORITY_NUM 4
+#define MSG_PRIORITY_NORMAL (MSG_PRIORITY_NUM - 1)
+
+/*
+ * メッセージのセグメント(kz_sendv(), kz_recvv())
+ * 構造体のサイズを2の累乗にして、配列の添字計算で乗算が出ないようにする
+ */
+typedef struct {
+  char *p; // セグメントの先頭
+  int size; // セグメントのサイズ
+  int dummy;
+} kz_iovec_t;
+
+/* ジョブ記述子 */
+typedef struct {
+  kz_job_func_t func; // ジョブの関数
+  void *arg; // ジョブの関数に渡す引数
+  kz_msgbox_id_t notify; // 完了通知先のメッセージボックス(MSGBOX_ID_NONE なら通知しない)
+} kz_job_t;
+
+/* スレッドの情報 */
+typedef struct {
+  kz_thread_id_t id; // スレッドID
+  char name[THREAD_NAME_SIZE + 1]; // スレッド名
+  int priority; // 優先度
+  uint32 period; // 周期(ミリ秒、周期スレッドでなければ0)
+  uint32 releases; // 周期起床の回数
+  uint32 overruns; // 周期内に処理が終わらなかった回数
+  uint32 jitter; // 直前のリリースジッタ(マイクロ秒)
+  uint32 jitter_max; // リリースジッタの最大値(マイクロ秒)
+  uint32 budget; // 1周期あたりの実行時間の上限(マイクロ秒、制限なしなら0)
+  uint32 used; // 今周期の実行時間(マイクロ秒)
+  uint32 exhausted; // 実行時間を使い切って優先度を下げられた回数
+} kz_thread_stat_t;
+
+/*
+ * メッセージボックスの統計情報
+ * 遅延(送信から受信までの時間)は 64 マイクロ秒未満を latency[0] とし、
+ * 以降は2倍ごとに区切って数える(最後の要素はそれ以上のすべて)
+ */
+#define MSGBOX_LATENCY_SHIFT 6
+#define MSGBOX_LATENCY_NUM 8
+typedef struct {
+  kz_msgbox_id_t id; // メッセージボックスID
+  int depth; // 格納されているメッセージの数
+  int peak; // 格納されたメッセージの数の最大値
+  uint32 total; // 送信されたメッセージの総数
+  uint32 waits; // 受信待ちでブロックした回数
+  uint32 wait_total; // 受信待ちの合計時間(マイクロ秒)
+  uint32 wait_max; // 受信待ちの最大時間(マイクロ秒)
+  uint16 latency[MSGBOX_LATENCY_NUM]; // 遅延のヒストグラム
+} kz_msgbox_stat_t;
+
+/* ワーカスレッドプールの統計情報 */
+typedef struct {
+  int workers; // ワーカスレッドの数
+  int idle; // ジョブ待ちのワーカスレッドの数
+  int queued; // キューに溜まっているジョブの数
+  int peak; // キューに溜まったジョブの数の最大値
+  uint32 posted; // 投入されたジョブの総数
+  uint32 done; // 完了したジョブの総数
+} kz_jobstat_t;
+
+/* 動的メモリの統計情報 */
+typedef struct {
+  uint16 used; // 使用中のブロック数
+  uint16 peak; // 使用中のブロック数の最大値
+  uint32 allocs; // 獲得の回数
+  uint16 spills; // 大きいプールから代わりに獲得した回数
+  uint16 fails; // 獲得できなかった回数
+} kz_memstat_t;
+
+/* カーネル情報ブロック(カーネルが更新し、スレッドからは読み出しのみ) */
+typedef struct {
+  kz_thread_id_t current; // 実行中のスレッドID
+  uint32 ticks; // 起動からのティック数
+  uint32 tick_usec; // 直前のティックの時刻(マイクロ秒)
+  uint32 tick_cycle; // 直前のティックの時刻(タイマのカウント数)
+  uint32 dispatches; // スレッドのディスパッチの回数
+  uint32 syscalls; // システムコールの回数
+  uint32 intrs; // 割込みの回数(システムコールのトラップを含む)
+  kz_memstat_t mem; // 動的メモリの統計情報
+} kz_kinfo_t;
 
 #endif
@@ -5,10 +5,14 @@
 #include "interrupt.h"
 #include "syscall.h"
 #include "lib.h"
+#include "timer.h"
+#include "swtimer.h"
+#include "bootprof.h"
+#include "ring.h"
 
-#define THREAD_NUM 6 // TCBの個数
-#define PRIORITY_NUM 16 // 優先度の個数
-#define THREAD_NAME_SIZE 15 // スレッド名の最大長
+#define THREAD_NUM KZ_CONFIG_THREAD_NUM // TCBの個数
+#define PRIORITY_NUM KZ_CONFIG_PRIORITY_NUM // 優先度の個数
+#define BUDGET_PRIORITY (PRIORITY_NUM - 2) // 実行時間を使い切ったスレッドの優先度(アイドルスレッドの1つ上)
 
 /* スレッドコンテキスト */
 // スレッドのコンテキスト保存用の構造体の定義
@@ -24,8 +28,24 @@ typedef struct _kz_thread {
   char name[THREAD_NAME_SIZE + 1]; // スレッド名
   int priority; // 優先度
   char *stack; // スタック
+  int stacksize; // スタックのサイズ
   uint32 flags; // 各種フラグ
 #define KZ_THREAD_FLAG_READY (1 << 0)
+#define KZ_THREAD_FLAG_WORKER (1 << 1) // ワーカスレッド
+#define KZ_THREAD_FLAG_RELEASED (1 << 2) // 周期起床して、まだディスパッチされていない
+#define KZ_THREAD_FLAG_DEMOTED (1 << 3) // 実行時間を使い切って優先度を下げられている
+#define KZ_THREAD_FLAG_CALLING (1 << 4) // kz_call() の処理中(送信待ちを含む)
+#define KZ_THREAD_FLAG_VECTOR (1 << 5) // kz_sendv(), kz_recvv() で送受信中
+#define KZ_THREAD_FLAG_INBOX (1 << 6) // kz_recv_self() で受信箱へのメッセージを待っている
+#define KZ_THREAD_FLAG_REPLYWAIT (1 << 7) // kz_call() の要求を格納済みで、応答を待っている
+
+#if KZ_CONFIG_USE_INBOX
+  /* 受信箱(kz_send_thread() で送信されたメッセージ。メッセージバッファを繋ぐ) */
+  struct {
+    struct _kz_msgbuf *head;
+    struct _kz_msgbuf *tail;
+  } inbox;
+#endif
 
   /* スレッドのスタートアップ(thread_init())に渡すパラメータ */
   struct {
@@ -40,6 +60,32 @@ typedef struct _kz_thread {
     kz_syscall_param_t *param;
   } syscall;
 
+#if KZ_CONFIG_USE_PERIODIC
+  /* 周期スレッドの情報 */
+  struct {
+    uint32 interval; // 周期(ティック数、周期スレッドでなければ0)
+    uint32 release; // 次のリリース時刻(ティック数)
+    uint32 release_usec; // 直前のリリース時刻(マイクロ秒)
+    uint32 releases; // 周期起床の回数
+    uint32 overruns; // 周期内に処理が終わらなかった回数
+    uint32 jitter; // 直前のリリースジッタ(マイクロ秒)
+    uint32 jitter_max; // リリースジッタの最大値(マイクロ秒)
+  } period;
+#endif
+
+#if KZ_CONFIG_USE_BUDGET
+  /* 実行時間の制限(スポラディックサーバ方式) */
+  struct {
+    uint32 budget; // 1周期あたりの実行時間の上限(マイクロ秒、制限なしなら0)
+    uint32 used; // 今周期の実行時間(マイクロ秒)
+    uint32 start; // ディスパッチされた時刻(マイクロ秒)
+    uint32 interval; // 補充周期(ティック数)
+    uint32 replenish; // 次の補充時刻(ティック数)
+    uint32 exhausted; // 実行時間を使い切った回数
+    int priority; // 本来の優先度
+  } budget;
+#endif
+
   kz_context context; // コンテキスト情報
 } kz_thread;
 
@@ -49,15 +95,88 @@ typedef struct _kz_msgbuf {
   kz_thread *sender; /* メッセージを送信したスレッド */
   struct {
     int size;
+#if KZ_CONFIG_USE_SENDV
+    int vector; // 0以外なら p はセグメントの配列で、size はその個数
+#endif
     char *p;
+#if KZ_CONFIG_USE_STATISTICS
+    uint32 stamp; // 送信時刻(統計情報用)
+#endif
   } param;
+  /*
+   * int を並べて詰め物を減らし、統計情報を使わない構成では16バイトにして
+   * メモリプールの16バイトのブロックに収める
+   */
 } kz_msgbuf;
 
-/* メッセージボックス */
+/* 構成によって省かれるメンバーの読み書き(省かれる場合は0として扱う) */
+#if KZ_CONFIG_USE_SENDV
+#define MSGBUF_VECTOR(mp) ((mp)->param.vector)
+#define MSGBUF_SET_VECTOR(mp, v) ((mp)->param.vector = (v))
+#else
+#define MSGBUF_VECTOR(mp) 0
+#define MSGBUF_SET_VECTOR(mp, v) ((void)(v))
+#endif
+#if KZ_CONFIG_USE_STATISTICS
+#define MSGBUF_STAMP(mp) ((mp)->param.stamp)
+#define MSGBUF_SET_STAMP(mp, v) ((mp)->param.stamp = (v))
+#else
+#define MSGBUF_STAMP(mp) 0
+#define MSGBUF_SET_STAMP(mp, v) ((void)(v))
+#endif
+
+/* メッセージスロット(メッセージボックスのリングバッファの要素) */
+typedef struct _kz_msgslot {
+  kz_thread *sender; /* メッセージを送信したスレッド */
+  char *p;
+  int size;
+  int vector; // 0以外なら p はセグメントの配列で、size はその個数
+  uint32 stamp; // 送信時刻(統計情報用)
+} kz_msgslot;
+
+/*
+ * メッセージボックス
+ * メッセージはスロットのリングバッファに格納する。スロットが一杯のときは
+ * メッセージバッファを獲得してリストに繋ぐ(リストのメッセージは常に
+ * スロットのメッセージより後に送信されたものになる)
+ * 格納できるメッセージの数が上限に達したら、送信したスレッドをブロックする
+ */
 typedef struct _kz_msgbox {
-  kz_thread *receiver; /* 受信待ち状態のスレッド */
+  kz_thread *receivers; /* 受信待ち状態のスレッドの待ち行列(next ポインタで繋ぐ) */
+  kz_thread *senders; /* 送信待ち状態のスレッドの待ち行列(next ポインタで繋ぐ) */
   kz_msgbuf *head;
   kz_msgbuf *tail;
+  kz_msgslot *slots; /* スロットの配列 */
+  int slotnum; /* スロットの数 */
+  int count; /* スロットに格納されているメッセージの数 */
+  int in; /* 次に格納するスロット */
+  int out; /* 次に取り出すスロット */
+  int num; /* 格納されているメッセージの数(スロットとリストの合計。上限と比較する) */
+  int limit; /* 格納できるメッセージの上限(0なら制限なし) */
+
+#if KZ_CONFIG_USE_MSGPRI
+  /*
+   * 優先度の高いメッセージ(MSG_PRIORITY_NORMAL 未満)のキュー
+   * メッセージのある優先度のビットを primap に立てておき、受信時には
+   * 最も優先度の高いキューを msgpri_first[] で直接求める
+   * 優先度の高いメッセージは上限に関係なく格納するので、num とは別に
+   * prinum で数える(num に含めると、通常のメッセージの枠を使ってしまう)
+   */
+  int primap;
+  int prinum; /* 優先度の高いメッセージの数 */
+  struct {
+    kz_msgbuf *head;
+    kz_msgbuf *tail;
+  } prique[MSG_PRIORITY_NORMAL];
+#if KZ_CONFIG_USE_STATISTICS
+  kz_msgbox_stat_t *stat; // 統計情報
+#else
+  int dummy[2];
+#endif
+#elif KZ_CONFIG_USE_STATISTICS
+  kz_msgbox_stat_t *stat; // 統計情報
+  int dummy[14];
+#endif
 
   /*
   * H8は16ビットCPUなので、32ビット整数に対しての乗算命令がない。よって
@@ -66,20 +185,192 @@ typedef struct _kz_msgbox {
   * ある。(2の累乗ならばシフト演算が利用されるので問題は出ない)
   * 対策として、サイズが2の累乗になるようにダミーメンバーで調整する
   * 他構造体で同様のエラーが出た場合には、同様の対処とすること
+  * (現在は64バイト(優先度付きのメッセージも統計情報も使わない構成では
+  * 32バイト)になっている。メンバーを増やすときは注意)
+  * なお -mh ではポインタと long は4バイト境界に置かれるので、int の後に
+  * ポインタを置くと詰め物が入る。int はなるべくまとめて並べること
   */
-  long dummy[1];
 } kz_msgbox;
 
+#if KZ_CONFIG_USE_MSGPRI
+/* primap から最も優先度の高い(最下位の)ビットの位置を得る */
+static const uint8 msgpri_first[1 << MSG_PRIORITY_NORMAL] = {
+  0, 0, 1, 0, 2, 0, 1, 0,
+};
+#endif
+
+/* メッセージボックスごとのスロット数 */
+static const int msgbox_slotnum[MSGBOX_ID_NUM] = {
+  [MSGBOX_ID_CONSOUTPUT] = KZ_CONFIG_MSGBOX_SLOTS_CONSOUTPUT,
+#if !KZ_CONFIG_USE_RING
+  [MSGBOX_ID_CONSINPUT] = KZ_CONFIG_MSGBOX_SLOTS_CONSINPUT,
+#endif
+#if KZ_CONFIG_USE_BENCH
+  [MSGBOX_ID_BENCHSLOT] = KZ_CONFIG_MSGBOX_SLOTS_BENCH,
+  [MSGBOX_ID_BENCHLIST] = 0, // 比較用にスロットを持たせない
+#endif
+};
+
+/* メッセージボックスごとのメッセージ数の上限 */
+static const int msgbox_limit[MSGBOX_ID_NUM] = {
+  [MSGBOX_ID_CONSOUTPUT] = KZ_CONFIG_MSGBOX_LIMIT_CONSOUTPUT,
+#if !KZ_CONFIG_USE_RING
+  [MSGBOX_ID_CONSINPUT] = KZ_CONFIG_MSGBOX_LIMIT_CONSINPUT,
+#endif
+#if KZ_CONFIG_USE_BENCH
+  [MSGBOX_ID_BENCHSLOT] = KZ_CONFIG_MSGBOX_LIMIT_BENCH,
+  [MSGBOX_ID_BENCHLIST] = KZ_CONFIG_MSGBOX_LIMIT_BENCH,
+#endif
+};
+
+/* 動的なメッセージボックスのスロット(作成時に割り当て済みのものを使う) */
+#if KZ_CONFIG_USE_MSGBOX_DYNAMIC
+#define MSGBOX_DYNAMIC_NUM KZ_CONFIG_MSGBOX_DYNAMIC_NUM
+#else
+#define MSGBOX_DYNAMIC_NUM 0
+#endif
+#define MSGSLOT_DYNAMIC_NUM (MSGBOX_DYNAMIC_NUM * KZ_CONFIG_MSGBOX_SLOTS_DYNAMIC)
+
+#if KZ_CONFIG_USE_RING
+#define MSGSLOT_STATIC_NUM KZ_CONFIG_MSGBOX_SLOTS_CONSOUTPUT
+#else
+#define MSGSLOT_STATIC_NUM (KZ_CONFIG_MSGBOX_SLOTS_CONSOUTPUT + KZ_CONFIG_MSGBOX_SLOTS_CONSINPUT)
+#endif
+
+#if KZ_CONFIG_USE_BENCH
+#define MSGSLOT_NUM (MSGSLOT_STATIC_NUM + KZ_CONFIG_MSGBOX_SLOTS_BENCH + MSGSLOT_DYNAMIC_NUM)
+#else
+#define MSGSLOT_NUM (MSGSLOT_STATIC_NUM + MSGSLOT_DYNAMIC_NUM)
+#endif
+
+/* メッセージボックスの数(静的なものの後ろに動的なものを置く) */
+#define MSGBOX_NUM (MSGBOX_ID_NUM + MSGBOX_DYNAMIC_NUM)
+
+/* メッセージボックスIDの構成 */
+#define MSGBOX_ID_INDEX(id) ((id) & 0xff) // メッセージボックスの番号
+#define MSGBOX_ID_GEN(id) ((id) >> 8) // 世代番号(削除されるごとに変わる)
+#define MSGBOX_ID_GEN_MASK 0x7f // IDが負にならないように7ビットにする
+
+#if KZ_CONFIG_USE_WORKPOOL
+/* ジョブ(ワーカスレッドプールのジョブキューに繋がれる) */
+typedef struct _kz_job {
+  struct _kz_job *next;
+  kz_job_t job;
+} kz_job;
+
+/* ワーカスレッドプール */
+static struct {
+  kz_job *head; // ジョブキューの先頭
+  kz_job *tail; // ジョブキューの末尾
+  kz_thread *idle; // ジョブ待ちのワーカスレッド(next ポインタで繋ぐ)
+  kz_jobstat_t stat; // 統計情報
+} workpool;
+#endif
+
+#if KZ_CONFIG_USE_RING
+/*
+ * リングバッファ
+ * 割込み処理(生産者)からスレッド(消費者)へのデータの受け渡しに使う。
+ * 消費者はデータがあればシステムコールなしで読み出し、データが足りない
+ * ときだけ kz_ring_wait() で待つ。生産者は待っている数に達したときだけ起床させる
+ */
+typedef struct _kz_ring {
+  kzring ring;
+  kz_thread *waiter; // データを待っている消費者のスレッド
+  int want; // 消費者が待っているバイト数
+  int dummy[7]; // 32バイトにする(kz_msgbox を参照)
+} kz_ring;
+
+/* リングバッファごとのサイズと、レコード単位で読み書きするかどうか */
+static const int ring_size[RING_ID_NUM] = {
+  [RING_ID_CONSINPUT] = KZ_CONFIG_RING_SIZE_CONSINPUT,
+};
+static const int ring_record[RING_ID_NUM] = {
+  [RING_ID_CONSINPUT] = 1,
+};
+
+#define RINGBUF_SIZE (KZ_CONFIG_RING_SIZE_CONSINPUT)
+
+static kz_ring rings[RING_ID_NUM];
+static char ringbufs[RINGBUF_SIZE];
+#endif
+
+#if KZ_CONFIG_USE_PIPE
+/*
+ * パイプ
+ * 読み出し待ちのスレッドがいるのはバッファが空のとき、書き込み待ちの
+ * スレッドがいるのはバッファが一杯のときに限られる
+ */
+typedef struct _kz_pipe {
+  kzring ring;
+  kz_thread *readers; // 読み出し待ちのスレッド(next ポインタで繋ぐ)
+  kz_thread *writers; // 書き込み待ちのスレッド(next ポインタで繋ぐ)
+  int used; // 使用中ならば0以外
+  int dummy[5]; // 32バイトにする(kzring は詰め物を含めて12バイト)
+} kz_pipe;
+
+static kz_pipe pipes[KZ_CONFIG_PIPE_NUM];
+static char pipebufs[KZ_CONFIG_PIPE_NUM * KZ_CONFIG_PIPE_SIZE];
+#endif
+
+#if KZ_CONFIG_USE_TOPIC
+/* トピック(既定の構成で16バイト) */
+typedef struct _kz_topic {
+  int used; // 使用中ならば0以外
+  int num; // 購読しているメッセージボックスの数
+  kz_msgbox_id_t subscribers[KZ_CONFIG_TOPIC_SUBSCRIBERS]; // 購読しているメッセージボックス
+} kz_topic;
+
+static kz_topic topics[KZ_CONFIG_TOPIC_NUM];
+
+/* 発行するメッセージの領域の直前に置く参照カウント(kz_topic_alloc() で確保する) */
+typedef struct _kz_topicbuf {
+  int refs; // 解放されていない配送先の数
+  int dummy;
+} kz_topicbuf;
+#endif
+
 /* スレッドのレディーキュー */
 static struct {
   kz_thread *head; // 先頭のエントリ
   kz_thread *tail; // 末尾のエントリ
 } readyque[PRIORITY_NUM];
 
+/* 終了したスレッドのスタック(新しいスレッドで再利用する) */
+static struct {
+  char *stack; // スタックの上端(未使用なら NULL)
+  int size;
+  int dummy; // 構造体のサイズを2の累乗にするためのダミー
+} freestacks[THREAD_NUM];
+
 static kz_thread *current; // カレントスレッド
+static kz_thread *handoff; // スケジューリングを省略して次に実行するスレッド(kz_call(), kz_reply())
 static kz_thread threads[THREAD_NUM]; // タスクコントロールブロック
 static kz_handler_t handlers[SOFTVEC_TYPE_NUM]; // 割込みハンドラ
-static kz_msgbox msgboxes[MSGBOX_ID_NUM]; /* メッセージボックス */
+static kz_fasthandler_t fasthandlers[SOFTVEC_TYPE_NUM]; // 高速割込みハンドラ
+static kz_msgbox msgboxes[MSGBOX_NUM]; /* メッセージボックス */
+
+/* メッセージボックスの使用状態(IDの検査に使う) */
+static struct {
+  uint8 used; // 使用中ならば0以外
+  uint8 gen; // 世代番号
+} msgbox_state[MSGBOX_NUM];
+static kz_msgslot msgslots[MSGSLOT_NUM]; /* メッセージスロット(各メッセージボックスに割り当てる) */
+#if KZ_CONFIG_USE_PERIODIC
+static kz_thread *periodque; // 次の周期を待つスレッド(リリース時刻の順に next ポインタで繋ぐ)
+#endif
+#if KZ_CONFIG_USE_BUDGET
+static int budget_num; // 実行時間の制限が設定されているスレッドの数
+#endif
+
+/*
+ * カーネル情報ブロック
+ * 時刻情報と統計情報をカーネルが更新し、スレッドからは kz_kinfo を通して
+ * システムコールを使わずに読み出す(時刻は32ビットで一周するので、
+ * 時間の計測には差分を利用すること)
+ */
+static kz_kinfo_t kinfo;
+const volatile kz_kinfo_t * const kz_kinfo = &kinfo;
 
 // スレッドのディスパッチ用関数(実態は startup.s にアセンブラで記述)
 void dispatch(kz_context *context);
@@ -127,6 +418,44 @@ static int putcurrent(void) {
   return 0;
 }
 
+/* 指定したスレッドをレディーキューから外す(カレントスレッド以外も外せる) */
+static void readyque_remove(kz_thread *thp) {
+  kz_thread **thpp;
+  kz_thread *prev = NULL;
+
+  if (!(thp->flags & KZ_THREAD_FLAG_READY)) {
+    return;
+  }
+
+  for (thpp = &readyque[thp->priority].head; *thpp; thpp = &(*thpp)->next) {
+    if (*thpp == thp) {
+      *thpp = thp->next;
+      if (readyque[thp->priority].tail == thp) {
+        readyque[thp->priority].tail = prev;
+      }
+      break;
+    }
+    prev = *thpp;
+  }
+  thp->flags &= ~KZ_THREAD_FLAG_READY;
+  thp->next = NULL;
+}
+
+/* 指定したスレッドの優先度を変更する(レディー状態ならレディーキューに繋ぎ直す) */
+static void thread_changepri(kz_thread *thp, int priority) {
+  kz_thread *save = current;
+
+  if (thp->flags & KZ_THREAD_FLAG_READY) {
+    readyque_remove(thp);
+    thp->priority = priority;
+    current = thp;
+    putcurrent();
+    current = save;
+  } else {
+    thp->priority = priority;
+  }
+}
+
 /* スレッドの終了 */
 static void thread_end(void) {
   kz_exit();
@@ -140,13 +469,55 @@ static void thread_init(kz_thread *thp) {
   thread_end();
 }
 
+/*
+ * スタック領域の獲得
+ * 終了したスレッドのスタックで収まるものがあれば再利用し、なければ
+ * スタック領域から新たに切り出す(再利用した場合は *sizep を実際のサイズにする)
+ */
+static char *stack_alloc(int *sizep) {
+  extern char userstack; // リンカスクリプトで定義されるスタック領域
+  static char *thread_stack = &userstack;
+  char *stack;
+  int i;
+
+  for (i = 0; i < THREAD_NUM; i++) {
+    if (freestacks[i].stack && (freestacks[i].size >= *sizep)) {
+      stack = freestacks[i].stack;
+      *sizep = freestacks[i].size;
+      freestacks[i].stack = NULL;
+      memset(stack - *sizep, 0, *sizep);
+      return stack;
+    }
+  }
+
+  memset(thread_stack, 0, *sizep);
+  thread_stack += *sizep;
+  return thread_stack;
+}
+
+/* スタック領域の開放(再利用のために登録する) */
+static void stack_free(char *stack, int size) {
+  int i;
+
+  for (i = 0; i < THREAD_NUM; i++) {
+    if (!freestacks[i].stack) {
+      freestacks[i].stack = stack;
+      freestacks[i].size = size;
+      return;
+    }
+  }
+}
+
 /* システムコールの処理(kz_run(): スレッドの起動) */
 static kz_thread_id_t thread_run(kz_func_t func, char *name, int priority, int stacksize, int argc, char *argv[]) {
   int i;
   kz_thread *thp;
   uint32 *sp;
-  extern char userstack; // リンカスクリプトで定義されるスタック領域
-  static char *thread_stack = &userstack;
+
+  if ((priority < 0) || (priority >= PRIORITY_NUM)) {
+    putcurrent();
+    return -1;
+  }
 
   /* 空いているタスクコントロールブロックを検索 */
   for (i = 0; i < THREAD_NUM; i++) {
@@ -158,6 +529,7 @@ static kz_thread_id_t thread_run(kz_func_t func, char *name, int priority, int s
   }
   if (i == THREAD_NUM) {
     // 見つからなかった
+    putcurrent();
     return -1;
   }
 
@@ -173,11 +545,13 @@ static kz_thread_id_t thread_run(kz_func_t func, char *name, int priority, int s
   thp->init.argc = argc;
   thp->init.argv = argv;
 
-  /* スタック領域を獲得 */
-  memset(thread_stack, 0, stacksize);
-  thread_stack += stacksize;
+#if KZ_CONFIG_USE_BOOTPROF
+  bootprof_mark(name); // スレッド名をチェックポイント名とする
+#endif
 
-  thp->stack = thread_stack;
+  /* スタック領域を獲得 */
+  thp->stack = stack_alloc(&stacksize);
+  thp->stacksize = stacksize;
   /* スタックの初期化 */
   // スタックに thread_init() からの戻り先として thread_end() を設定する
   sp = (uint32 *)thp->stack;
@@ -215,14 +589,38 @@ static kz_thread_id_t thread_run(kz_func_t func, char *name, int priority, int s
   return (kz_thread_id_t)current;
 }
 
+#if KZ_CONFIG_USE_INBOX
+/* 終了するスレッドの受信箱に残っているメッセージバッファを解放する */
+static void inbox_clear(kz_thread *thp) {
+  kz_msgbuf *mp;
+
+  while ((mp = thp->inbox.head) != NULL) {
+    thp->inbox.head = mp->next;
+    kzmem_free(mp);
+  }
+}
+#endif
+
 /* システムコールの処理(kz_exit(): スレッドの終了) */
 static int thread_exit(void) {
   /*
-  * 本来ならスタックも開放して再利用できるようにすべきだが省略
-  * このため、スレッドを頻繁に生成・消去するようなことは現状できない
+  * スタックは次に生成するスレッドで再利用する
+  * システムコールの処理(_intr_syscall)は割込みスタックに切り替えず、終了する
+  * スレッドのスタック上で動作している。それでも開放してよいのは、空きスタックの
+  * 一覧に登録するだけで、ディスパッチまでの間にスタックを獲得する処理がなく、
+  * 次のディスパッチ以降はこのスタックを使わないため
   */
   puts(current->name);
   puts(" EXIT.\n");
+#if KZ_CONFIG_USE_BUDGET
+  if (current->budget.budget) {
+    budget_num--;
+  }
+#endif
+  stack_free(current->stack, current->stacksize);
+#if KZ_CONFIG_USE_INBOX
+  inbox_clear(current);
+#endif
   memset(current, 0, sizeof(*current));
   return 0;
 }
@@ -262,6 +660,25 @@ static kz_thread_id_t thread_getid(void) {
 /* システムコールの処理(kz_chpri(): スレッドの優先度変更) */
 static int thread_chpri(int priority) {
   int old = current->priority;
+
+  if (priority >= PRIORITY_NUM) {
+    putcurrent();
+    return -1; // レディーキューの範囲外
+  }
+
+#if KZ_CONFIG_USE_BUDGET
+  if (current->budget.budget) {
+    /* 実行時間の制限中は本来の優先度を変更し、補充時に反映させる */
+    old = current->budget.priority;
+    if (priority >= 0) {
+      current->budget.priority = priority;
+    }
+    if (current->flags & KZ_THREAD_FLAG_DEMOTED) {
+      priority = -1;
+    }
+  }
+#endif
+
   if (priority >= 0) {
     current->priority = priority;
   }
@@ -282,19 +699,82 @@ static int thread_kmfree(char *p) {
   return 0;
 }
 
-/* メッセージの送信処理 */
-static void sendmsg(kz_msgbox *mboxp, kz_thread *thp, int size, char *p) {
+#if KZ_CONFIG_USE_STATISTICS
+static kz_msgbox_stat_t msgbox_stats[MSGBOX_NUM]; // メッセージボックスの統計情報
+#endif
+
+/* 格納されているメッセージの数(優先度の高いメッセージも含む) */
+#if KZ_CONFIG_USE_MSGPRI
+#define MSGBOX_DEPTH(mboxp) ((mboxp)->num + (mboxp)->prinum)
+#else
+#define MSGBOX_DEPTH(mboxp) ((mboxp)->num)
+#endif
+
+/* 格納したメッセージの統計を取る(統計情報を有効にしている場合は送信時刻を返す) */
+static uint32 msgbox_enqueued(kz_msgbox *mboxp) {
+#if KZ_CONFIG_USE_STATISTICS
+  mboxp->stat->total++;
+  if (MSGBOX_DEPTH(mboxp) > mboxp->stat->peak) {
+    mboxp->stat->peak = MSGBOX_DEPTH(mboxp);
+  }
+  return kz_gettime();
+#else
+  return 0;
+#endif
+}
+
+/* 送信から受信までの遅延をヒストグラムに数える */
+static void msgbox_latency(kz_msgbox *mboxp, uint32 stamp) {
+#if KZ_CONFIG_USE_STATISTICS
+  uint32 latency = kz_gettime() - stamp;
+  int i;
+
+  for (i = 0, latency >>= MSGBOX_LATENCY_SHIFT; latency && (i < MSGBOX_LATENCY_NUM - 1); latency >>= 1) {
+    i++;
+  }
+  if (mboxp->stat->latency[i] != 0xffff) { // 溢れないように飽和させる
+    mboxp->stat->latency[i]++;
+  }
+#endif
+}
+
+/*
+ * メッセージの送信処理
+ * メッセージバッファを獲得できない場合は、格納せずに -1 を返す
+ */
+static int sendmsg(kz_msgbox *mboxp, kz_thread *thp, int size, char *p, int vector) {
+  kz_msgslot *sp;
   kz_msgbuf *mp;
 
+  /*
+   * スロットに空きがあり、リストに繋がれたメッセージもなければスロットに格納する
+   * (メモリの獲得が不要で、一定時間で処理できる)
+   */
+  if (!mboxp->head && (mboxp->count < mboxp->slotnum)) {
+    sp = mboxp->slots + mboxp->in;
+    sp->sender = thp;
+    sp->size = size;
+    sp->p = p;
+    sp->vector = vector;
+    if (++mboxp->in == mboxp->slotnum) {
+      mboxp->in = 0;
+    }
+    mboxp->count++;
+    mboxp->num++;
+    sp->stamp = msgbox_enqueued(mboxp);
+    return 0;
+  }
+
   /* メッセージバッファの作成 */
   mp = (kz_msgbuf *)kzmem_alloc(sizeof(*mp)); // メッセージバッファを獲得する
   if (mp == NULL) {
-    kz_sysdown();
+    return -1;
   }
   mp->next = NULL;
   mp->sender = thp;
   mp->param.size = size;
   mp->param.p = p;
+  MSGBUF_SET_VECTOR(mp, vector);
 
   /* メッセージボックスの末尾にメッセージを接続する */
   if (mboxp->tail) {
@@ -303,22 +783,53 @@ static void sendmsg(kz_msgbox *mboxp, kz_thread *thp, int size, char *p) {
     mboxp->head = mp;
   }
   mboxp->tail = mp;
+  mboxp->num++;
+  MSGBUF_SET_STAMP(mp, msgbox_enqueued(mboxp));
+  return 0;
 }
 
-static void recvmsg(kz_msgbox *mboxp) {
+#if KZ_CONFIG_USE_MSGPRI
+/*
+ * 優先度の高いメッセージを優先度ごとのキューの末尾に繋ぐ(上限には関係なく格納する)
+ * メッセージバッファを獲得できない場合は -1 を返す
+ */
+static int sendmsg_pri(kz_msgbox *mboxp, kz_thread *thp, int size, char *p, int priority) {
   kz_msgbuf *mp;
-  kz_syscall_param_t *p;
 
-  /* メッセージボックスの先頭にあるメッセージを抜き出す */
-  mp = mboxp->head;
-  mboxp->head = mp->next;
-  if (mboxp->head == NULL) {
-    mboxp->tail = NULL;
+  mp = (kz_msgbuf *)kzmem_alloc(sizeof(*mp));
+  if (mp == NULL) {
+    return -1;
   }
   mp->next = NULL;
+  mp->sender = thp;
+  mp->param.size = size;
+  mp->param.p = p;
+  MSGBUF_SET_VECTOR(mp, 0);
+
+  if (mboxp->prique[priority].tail) {
+    mboxp->prique[priority].tail->next = mp;
+  } else {
+    mboxp->prique[priority].head = mp;
+  }
+  mboxp->prique[priority].tail = mp;
+  mboxp->primap |= (1 << priority);
+  mboxp->prinum++;
+  MSGBUF_SET_STAMP(mp, msgbox_enqueued(mboxp));
+  return 0;
+}
+#endif
+
+#if KZ_CONFIG_USE_INBOX
+/* 受信箱からメッセージを取り出して、受信するスレッドに返す値を設定する */
+static void inbox_recv(kz_thread *thp) {
+  kz_msgbuf *mp = thp->inbox.head;
+  kz_syscall_param_t *p = thp->syscall.param;
+
+  thp->inbox.head = mp->next;
+  if (thp->inbox.head == NULL) {
+    thp->inbox.tail = NULL;
+  }
 
-  /* メッセージを受信するスレッドに返す値を設定する */
-  p = mboxp->receiver->syscall.param;
   p->un.recv.ret = (kz_thread_id_t)mp->sender;
   if (p->un.recv.sizep) {
     *(p->un.recv.sizep) = mp->param.size;
@@ -326,226 +837,2085 @@ static void recvmsg(kz_msgbox *mboxp) {
   if (p->un.recv.pp) {
     *(p->un.recv.pp) = mp->param.p;
   }
-
-  /* 受信待ちスレッドはいなくなったので、NULLに戻す */
-  mboxp->receiver = NULL;
-
-  /* メッセージバッファの開放 */
   kzmem_free(mp);
 }
-
-/* システムコールの処理(kz_send(): メッセージ送信) */
-static int thread_send(kz_msgbox_id_t id, int size, char *p) {
-  kz_msgbox *mboxp = &msgboxes[id];
-
-  putcurrent();
-  sendmsg(mboxp, current, size, p);
-
-  /* 受信待ちスレッドが存在している場合には受信処理をおこなう */
-  if (mboxp->receiver) {
-    current = mboxp->receiver; // 受信待ちスレッド
-    recvmsg(mboxp); // メッセージの受信処理
-    putcurrent(); // 受信により動作可能になったので、ブロック解除する
+#endif
+
+/*
+ * 待ち行列にスレッドを繋ぐ
+ * 到着順か、優先度順(同じ優先度なら到着順)に並べる
+ */
+static void waitque_insert(kz_thread **queue, kz_thread *thp) {
+  kz_thread **thpp;
+
+  for (thpp = queue; *thpp; thpp = &(*thpp)->next) {
+#if KZ_CONFIG_MSGBOX_WAIT_PRIORITY
+    if ((*thpp)->priority > thp->priority) {
+      break;
+    }
+#endif
   }
-
-  return size;
+  thp->next = *thpp;
+  *thpp = thp;
 }
 
-static kz_thread_id_t thread_recv(kz_msgbox_id_t id, int *sizep, char **pp) {
-  kz_msgbox *mboxp = &msgboxes[id];
+/* 送信待ちのスレッドがあれば、空いた分のメッセージを送信してブロック解除する */
+static void wakesender(kz_msgbox *mboxp) {
+  kz_thread *thp, *save = current;
+  kz_syscall_param_t *p;
 
-  if (mboxp->receiver) {
-    kz_sysdown();
+  thp = mboxp->senders;
+  if (thp == NULL) {
+    return;
   }
+  mboxp->senders = thp->next;
+  thp->next = NULL;
 
-  mboxp->receiver = current; // 受信待ちスレッドに設定
-
-  if (mboxp->head == NULL) {
+  /* 送信するメッセージは、送信待ちスレッドのパラメータ領域にある */
+  p = thp->syscall.param;
+  if (sendmsg(mboxp, thp, p->un.send.size, p->un.send.p, thp->flags & KZ_THREAD_FLAG_VECTOR) < 0) {
     /*
-    * メッセージボックスにメッセージがないので、スレッドを
-    * スリープさせる。(システムコールをブロックする)
-    */
-    return -1;
+     * メッセージバッファを獲得できなかったので、送信の失敗として
+     * ブロック解除する(kz_sendv() でコピーした配列はここで解放する)
+     */
+    if (thp->flags & KZ_THREAD_FLAG_VECTOR) {
+      kzmem_free(p->un.send.p);
+    }
+    p->un.send.ret = -1;
+    thp->flags &= ~(KZ_THREAD_FLAG_VECTOR | KZ_THREAD_FLAG_CALLING);
+  } else {
+    p->un.send.ret = p->un.send.size;
+    thp->flags &= ~KZ_THREAD_FLAG_VECTOR;
   }
 
-  recvmsg(mboxp); /* メッセージの受信処理 */
-  putcurrent(); // メッセージを受信できたので、レディー状態にする
-
-  return current->syscall.param->un.recv.ret;
+  /* kz_call() の場合は、要求が格納されたので引き続き応答を待つ */
+  if (thp->flags & KZ_THREAD_FLAG_CALLING) {
+    thp->flags |= KZ_THREAD_FLAG_REPLYWAIT;
+  } else {
+    current = thp;
+    putcurrent();
+    current = save;
+  }
 }
 
-/* システムコールの処理(kz_setintr(): 割込みハンドラの登録) */
-static int thread_setintr(softvec_type_t type, kz_handler_t handler) {
-  static void thread_intr(softvec_type_t type, unsigned long sp);
+static void recvmsg(kz_msgbox *mboxp, kz_thread *thp) {
+  kz_msgslot *sp;
+  kz_msgbuf *mp = NULL;
+  kz_syscall_param_t *p;
+  kz_thread *sender;
+  int size, vector;
+#if KZ_CONFIG_USE_MSGPRI
+  int priority = MSG_PRIORITY_NORMAL;
+#endif
+  uint32 stamp;
+  char *msg;
+
+#if KZ_CONFIG_USE_MSGPRI
+  if (mboxp->primap) {
+    /* 優先度の高いメッセージがあれば、最も優先度の高いキューから取り出す */
+    priority = msgpri_first[mboxp->primap];
+    mp = mboxp->prique[priority].head;
+    mboxp->prique[priority].head = mp->next;
+    if (mboxp->prique[priority].head == NULL) {
+      mboxp->prique[priority].tail = NULL;
+      mboxp->primap &= ~(1 << priority);
+    }
+    mboxp->prinum--;
+    mp->next = NULL;
+    sender = mp->sender;
+    size = mp->param.size;
+    msg = mp->param.p;
+    vector = MSGBUF_VECTOR(mp);
+    stamp = MSGBUF_STAMP(mp);
+  } else
+#endif
+  if (mboxp->count) {
+    /* スロットのメッセージの方が古いので、先に取り出す */
+    sp = mboxp->slots + mboxp->out;
+    sender = sp->sender;
+    size = sp->size;
+    msg = sp->p;
+    vector = sp->vector;
+    stamp = sp->stamp;
+    if (++mboxp->out == mboxp->slotnum) {
+      mboxp->out = 0;
+    }
+    mboxp->count--;
+    mboxp->num--;
+  } else {
+    /* メッセージボックスの先頭にあるメッセージを抜き出す */
+    mp = mboxp->head;
+    mboxp->head = mp->next;
+    if (mboxp->head == NULL) {
+      mboxp->tail = NULL;
+    }
+    mp->next = NULL;
+    sender = mp->sender;
+    size = mp->param.size;
+    msg = mp->param.p;
+    vector = MSGBUF_VECTOR(mp);
+    stamp = MSGBUF_STAMP(mp);
+    mboxp->num--;
+  }
+  msgbox_latency(mboxp, stamp);
 
-  /*
-  * 割込みを受け付けるために、ソフトウェア割込みベクタに
-  * OSの割込み処理の入り口となる関数を登録する
-  */
-  softvec_setintr(type, thread_intr);
+  /* メッセージを受信するスレッドに返す値を設定する */
+  p = thp->syscall.param;
+  p->un.recv.ret = (kz_thread_id_t)sender;
+#if KZ_CONFIG_USE_SENDV
+  if (thp->flags & KZ_THREAD_FLAG_VECTOR) {
+    /* kz_recvv() ならば、セグメントの配列として返す */
+    thp->flags &= ~KZ_THREAD_FLAG_VECTOR;
+    if (vector) {
+      memcpy(p->un.recvv.iov, msg, size * sizeof(kz_iovec_t));
+    } else {
+      p->un.recvv.iov->p = msg;
+      p->un.recvv.iov->size = size;
+      size = 1;
+    }
+  } else
+#endif
+  if (vector) {
+    size *= sizeof(kz_iovec_t); // kz_recv() ならば、セグメントの配列をそのまま返す
+  }
+  if (p->un.recv.sizep) {
+    *(p->un.recv.sizep) = size;
+  }
+  if (p->un.recv.pp) {
+    *(p->un.recv.pp) = msg;
+  }
 
-  handlers[type] = handler;
+  /* メッセージバッファの開放 */
+  if (mp) {
+    kzmem_free(mp);
+  }
 
-  putcurrent();
-  return 0;
+  /*
+   * 空きができたので、送信待ちのスレッドがあれば送信させる
+   * (優先度の高いメッセージは上限に数えないので、取り出しても空きはできない)
+   */
+#if KZ_CONFIG_USE_MSGPRI
+  if (priority == MSG_PRIORITY_NORMAL)
+#endif
+  wakesender(mboxp);
 }
 
-static void call_functions(kz_syscall_type_t type, kz_syscall_param_t *p) {
-  /* システムコールの実行中に current が書き換わるので注意 */
-  switch (type) {
-    case KZ_SYSCALL_TYPE_RUN:
-      p->un.run.ret = thread_run(
-        p->un.run.func, p->un.run.name,
-        p->un.run.priority, p->un.run.stacksize,
-        p->un.run.argc, p->un.run.argv
-      );
-      break;
-    case KZ_SYSCALL_TYPE_EXIT:
-      /* TCBが消去されるので戻り値を書き込んではいけない */
-      thread_exit();
-      break;
-    case KZ_SYSCALL_TYPE_WAIT:
-      p->un.wait.ret = thread_wait();
-      break;
-    case KZ_SYSCALL_TYPE_SLEEP:
-      p->un.sleep.ret = thread_sleep();
-      break;
-    case KZ_SYSCALL_TYPE_WAKEUP:
-      p->un.wakeup.ret = thread_wakeup(p->un.wakeup.id);
-      break;
-    case KZ_SYSCALL_TYPE_GETID:
-      p->un.getid.ret = thread_getid();
-      break;
-    case KZ_SYSCALL_TYPE_CHPRI:
-      p->un.chpri.ret = thread_chpri(p->un.chpri.priority);
-      break;
-    case KZ_SYSCALL_TYPE_KMALLOC:
-      p->un.kmalloc.ret = thread_kmalloc(p->un.kmalloc.size);
-      break;
-    case KZ_SYSCALL_TYPE_KMFREE:
-      p->un.kmfree.ret = thread_kmfree(p->un.kmfree.p);
-      break;
-    case KZ_SYSCALL_TYPE_SEND:
-      p->un.send.ret = thread_send(p->un.send.id, p->un.send.size, p->un.send.p);
-      break;
-    case KZ_SYSCALL_TYPE_RECV:
-      p->un.recv.ret = thread_recv(p->un.recv.id, p->un.recv.sizep, p->un.recv.pp);
-      break;
-    case KZ_SYSCALL_TYPE_SETINTR:
-      p->un.setintr.ret = thread_setintr(p->un.setintr.type, p->un.setintr.handler);
-      break;
-    default:
-      break;
+/*
+ * メッセージボックスIDからメッセージボックスを得る(不正なIDならば NULL)
+ * 削除されたメッセージボックスのIDは、世代番号が一致しないので検出できる
+ */
+static kz_msgbox *msgbox_get(kz_msgbox_id_t id) {
+  int index = MSGBOX_ID_INDEX(id);
+
+  if ((id < 0) || (index >= MSGBOX_NUM) || !msgbox_state[index].used ||
+      (msgbox_state[index].gen != MSGBOX_ID_GEN(id))) {
+    return NULL;
   }
+  return &msgboxes[index];
 }
 
-/* システムコールの処理 */
-static void syscall_proc(kz_syscall_type_t type, kz_syscall_param_t *p) {
-  /*
-  * システムコールを呼び出したスレッドをレディーキューから
-  * 外した状態で処理関数を呼び出す。このためシステムコールを
-  * 呼び出したスレッドをそのまま動作継続させたいばあいには、
-  * 処理関数の内部で putcurrent() を行う必要がある
-  */
-  getcurrent(); // カレントスレッドをレディーキューから外す
-  call_functions(type, p); // システムコールの処理関数を呼び出す
+/* 受信待ちスレッドが存在している場合には、待ち行列の先頭のスレッドが受信する */
+static void wakereceiver(kz_msgbox *mboxp) {
+#if KZ_CONFIG_USE_STATISTICS
+  uint32 wait;
+#endif
+
+  if (mboxp->receivers) {
+    current = mboxp->receivers; // 受信待ちスレッド
+    mboxp->receivers = current->next;
+    current->next = NULL;
+#if KZ_CONFIG_USE_STATISTICS
+    /* 受信待ちの開始時刻は、戻り値の領域に置いてある */
+    wait = kz_gettime() - current->syscall.param->un.recv.ret;
+    mboxp->stat->waits++;
+    mboxp->stat->wait_total += wait;
+    if (wait > mboxp->stat->wait_max) {
+      mboxp->stat->wait_max = wait;
+    }
+#endif
+    recvmsg(mboxp, current); // メッセージの受信処理
+    putcurrent(); // 受信により動作可能になったので、ブロック解除する
+  }
 }
 
-/* サービスコールの処理 */
-static void srvcall_proc(kz_syscall_type_t type, kz_syscall_param_t *p) {
-  /*
-  * システムコールとサービスコールの処理関数の内部で
-  * システムコールの実行したスレッドIDを得るために current を
-  * 参照している部分があり(たとえば thread_send() など)、
-  * current が残っていると誤動作するため NULL に設定する。
-  * サービスコールは thread_intrvec() 内部の割込みハンドラ呼び出しの
-  * 延長で呼ばれているはずなので、呼び出し後に thread_intrvec() で
-  * スケジューリング処理が行われ、 curret は再設定される
-  */
-  current = NULL;
-  call_functions(type, p);
-}
+/*
+ * システムコールの処理(kz_send(), kz_trysend(): メッセージ送信)
+ * メッセージボックスが一杯の場合、block が0以外ならば空きができるまで
+ * ブロックする。ブロックしない場合とサービスコールの場合は -1 を返す
+ */
+static int thread_send(kz_msgbox_id_t id, int size, char *p, int block) {
+  kz_msgbox *mboxp = msgbox_get(id);
 
-/* スレッドのスケジューリング */
-static void schedule(void) {
-  int i;
-  /*
-  * 優先順位の高い順(優先度の数値の小さい順)にレディーキューを見て、
-  * 動作可能なスレッドを検索する
-  */
-  for (i = 0; i < PRIORITY_NUM; i++) {
-    if (readyque[i].head) {
-      break;
+  if (mboxp == NULL) {
+    putcurrent();
+    return -1;
+  }
+
+  if (mboxp->limit && (mboxp->num >= mboxp->limit)) {
+    if (block && current) {
+      waitque_insert(&mboxp->senders, current);
+      return -1; // 戻り値は送信時に設定される
     }
+    putcurrent();
+    return -1;
   }
-  if (i == PRIORITY_NUM) {
-    kz_sysdown();
+
+  putcurrent();
+  if (sendmsg(mboxp, current, size, p, current && (current->flags & KZ_THREAD_FLAG_VECTOR)) < 0) {
+    return -1; // メッセージバッファを獲得できない
   }
-  current = readyque[i].head;
-}
+  wakereceiver(mboxp);
 
-// システムコールの呼び出し
-static void syscall_intr(void) {
-  syscall_proc(current->syscall.type, current->syscall.param);
+  return size;
 }
 
-static void softerr_intr(void) {
-  // ソフトウェアエラーが発生し場合は、スレッドを強制終了する
-  puts(current->name);
-  puts(" DOWN.\n");
-  getcurrent();
-  thread_exit();
+#if KZ_CONFIG_USE_INBOX || KZ_CONFIG_USE_CALL || KZ_CONFIG_USE_MODULE
+/*
+ * スレッドIDからTCBを得る(不正なIDか未使用のTCBならば NULL)
+ * 範囲内でもTCBの境界を指していないIDがあるので、配列の要素と比較する
+ * (TCBのサイズは2の累乗ではないので、剰余で確認すると32ビットの除算になる)
+ */
+static kz_thread *thread_get(kz_thread_id_t id) {
+  kz_thread *thp;
+  int i;
+
+  for (i = 0; i < THREAD_NUM; i++) {
+    thp = &threads[i];
+    if (thp == (kz_thread *)id) {
+      return thp->init.func ? thp : NULL;
+    }
+  }
+  return NULL;
 }
+#endif
+
+#if KZ_CONFIG_USE_INBOX
+/*
+ * システムコールの処理(kz_send_thread(): スレッドの受信箱への送信)
+ * メッセージボックスを検索せずに、送信先のTCBの受信箱に直接繋ぐ
+ */
+static int thread_send_thread(kz_thread_id_t id, int size, char *p) {
+  kz_thread *thp = thread_get(id);
+  kz_thread *save = current;
+  kz_msgbuf *mp;
 
-/* 割込み処理の入り口関数 */
-static void thread_intr(softvec_type_t type, unsigned long sp) {
-  /* カレントスレッドのコンテキストを保存する */
-  current->context.sp = sp;
+  putcurrent();
 
-  /*
-  * 割込みごとの処理を実行する
-  * SOFTVEC_TYPE_SYSCALL, SOFTVEC_TYPE_SOFTERR の場合は
-  * syscall_intr(), softerr_intr() がハンドラに登録されているので、
-  * それらが実行される
-  * それ以外の場合は、kz_setintr() によってユーザ登録されたハンドラが
-  * 実行される
-  */
-  if (handlers[type]) {
-    handlers[type]();
+  if (thp == NULL) {
+    return -1;
   }
-  schedule();
 
-  /*
-  * スレッドのディスパッチ
-  * (dispatch()関数の本体は startup.s にあり、アセンブラで記述されている)
-  */
-  dispatch(&current->context);
-  /* ここには返ってこない */
+  mp = (kz_msgbuf *)kzmem_alloc(sizeof(*mp));
+  if (mp == NULL) {
+    return -1; // メッセージバッファを獲得できない
+  }
+  mp->next = NULL;
+  mp->sender = current;
+  mp->param.size = size;
+  mp->param.p = p;
+  MSGBUF_SET_VECTOR(mp, 0);
+
+  if (thp->inbox.tail) {
+    thp->inbox.tail->next = mp;
+  } else {
+    thp->inbox.head = mp;
+  }
+  thp->inbox.tail = mp;
+
+  /* 送信先が受信待ちならば、受信させて起床させる */
+  if (thp->flags & KZ_THREAD_FLAG_INBOX) {
+    thp->flags &= ~KZ_THREAD_FLAG_INBOX;
+    inbox_recv(thp);
+    current = thp;
+    putcurrent();
+    current = save;
+  }
+
+  return size;
 }
 
-void kz_start(kz_func_t func, char *name, int priority, int stacksize, int argc, char *argv[]) {
-  /* 動的メモリの初期化 */
-  kzmem_init();
+/* システムコールの処理(kz_recv_self(): 自スレッドの受信箱からの受信) */
+static kz_thread_id_t thread_recv_self(void) {
+  if (current->inbox.head == NULL) {
+    /* メッセージがないので、送信されるまでスリープする */
+    current->flags |= KZ_THREAD_FLAG_INBOX;
+    return -1; // 戻り値は受信時に設定される
+  }
 
-  /*
-  * 以降で呼び出すスレッド関連のライブラリ関数の内部で current を
+  inbox_recv(current);
+  putcurrent();
+
+  return current->syscall.param->un.recv.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_MSGPRI
+/*
+ * システムコールの処理(kz_sendpri(): 優先度付きのメッセージ送信)
+ * 通常の優先度ならば kz_send() と同じ。それより高い優先度のメッセージは
+ * 上限に関わらず格納し、ブロックしない
+ */
+static int thread_sendpri(kz_msgbox_id_t id, int size, char *p, int priority) {
+  kz_msgbox *mboxp = msgbox_get(id);
+
+  if (priority == MSG_PRIORITY_NORMAL) {
+    return thread_send(id, size, p, 1);
+  }
+
+  putcurrent();
+  if ((mboxp == NULL) || (priority < 0) || (priority > MSG_PRIORITY_NORMAL)) {
+    return -1;
+  }
+
+  if (sendmsg_pri(mboxp, current, size, p, priority) < 0) {
+    return -1;
+  }
+  wakereceiver(mboxp);
+
+  return size;
+}
+#endif
+
+#if KZ_CONFIG_USE_SENDV
+/*
+ * システムコールの処理(kz_sendv(): セグメントの配列の送信)
+ * セグメントの配列だけを動的メモリにコピーして、1つのメッセージとして送信する
+ * (セグメントの内容はコピーしない)。配列は受信したスレッドが解放する
+ */
+static int thread_sendv(kz_msgbox_id_t id, kz_iovec_t *iov, int iovcnt) {
+  kz_syscall_param_t *p = current->syscall.param;
+  kz_thread *thp = current;
+  kz_iovec_t *vp;
+  int ret;
+
+  if ((iovcnt <= 0) || (iovcnt > KZ_CONFIG_IOV_MAX) || !msgbox_get(id)) {
+    putcurrent();
+    return -1;
+  }
+
+  vp = kzmem_alloc(iovcnt * sizeof(kz_iovec_t));
+  if (vp == NULL) {
+    putcurrent();
+    return -1; // 配列をコピーする領域を獲得できない
+  }
+  memcpy(vp, iov, iovcnt * sizeof(kz_iovec_t));
+
+  /* 送信待ちになった場合は、パラメータ領域のコピーした配列を送信する */
+  p->un.sendv.iov = vp;
+
+  thp->flags |= KZ_THREAD_FLAG_VECTOR;
+  ret = thread_send(id, iovcnt, (char *)vp, 1);
+  if (ret >= 0) {
+    thp->flags &= ~KZ_THREAD_FLAG_VECTOR;
+  } else if (thp->flags & KZ_THREAD_FLAG_READY) {
+    /* 送信待ちではなく送信に失敗したので、コピーした配列を解放する */
+    thp->flags &= ~KZ_THREAD_FLAG_VECTOR;
+    kzmem_free(vp);
+  }
+
+  return ret;
+}
+#endif
+
+static kz_thread_id_t thread_recv(kz_msgbox_id_t id, int *sizep, char **pp) {
+  kz_msgbox *mboxp = msgbox_get(id);
+
+  if (mboxp == NULL) {
+    current->flags &= ~KZ_THREAD_FLAG_VECTOR;
+    putcurrent();
+    return 0;
+  }
+
+  if (!MSGBOX_DEPTH(mboxp)) {
+    /*
+    * メッセージボックスにメッセージがないので、受信待ちの待ち行列に
+    * 繋いでスレッドをスリープさせる。(システムコールをブロックする)
+    */
+    waitque_insert(&mboxp->receivers, current);
+#if KZ_CONFIG_USE_STATISTICS
+    /*
+     * 戻り値は受信時に設定し直されるので、受信待ちの時間を求めるために
+     * それまでは戻り値の領域に開始時刻を置いておく
+     */
+    return kz_gettime();
+#else
+    return -1;
+#endif
+  }
+
+  recvmsg(mboxp, current); /* メッセージの受信処理 */
+  putcurrent(); // メッセージを受信できたので、レディー状態にする
+
+  return current->syscall.param->un.recv.ret;
+}
+
+#if KZ_CONFIG_USE_CALL
+/*
+ * 直接切り替えてよいスレッドならば、次に実行するスレッドとして設定する
+ * 切り替え元のスレッドは実行中だったので、それより優先度の高いレディー状態の
+ * スレッドはない。よって切り替え先の優先度が切り替え元以上で、レディーキューの
+ * 先頭にあれば、schedule() で検索しても同じスレッドが選ばれる
+ */
+static void sethandoff(kz_thread *from, kz_thread *to) {
+  if (from && (to->flags & KZ_THREAD_FLAG_READY) &&
+      (to->priority <= from->priority) && (readyque[to->priority].head == to)) {
+    handoff = to;
+  }
+}
+
+/*
+ * システムコールの処理(kz_call(): 要求の送信と応答の待ち合わせ)
+ * 要求はメッセージとして送信し(受信したスレッドには呼び出し元のスレッドIDが
+ * 返る)、kz_reply() で応答されるまでブロックする
+ */
+static int thread_call(kz_msgbox_id_t id, int size, char *p) {
+  kz_msgbox *mboxp = msgbox_get(id);
+  kz_thread *thp = current;
+  kz_thread *server; // 要求を受信するスレッド
+  int ret;
+
+  if (mboxp == NULL) {
+    putcurrent();
+    return -1;
+  }
+  server = mboxp->receivers;
+
+  thp->flags |= KZ_THREAD_FLAG_CALLING;
+  ret = thread_send(id, size, p, 1); // 一杯ならば送信待ちになる
+  current = thp;
+  if (ret < 0) {
+    if (thp->flags & KZ_THREAD_FLAG_READY) {
+      thp->flags &= ~KZ_THREAD_FLAG_CALLING; // 送信できなかった
+    }
+    return -1; // 送信待ちなら、要求が格納されてから応答を待つ(wakesender())
+  }
+
+  /* 送信できたので、レディーキューから外して応答を待つ */
+  thp->flags |= KZ_THREAD_FLAG_REPLYWAIT;
+  readyque_remove(thp);
+
+  /* 受信待ちだったスレッドに直接切り替える */
+  if (server) {
+    sethandoff(thp, server);
+  }
+
+  return 0; // 戻り値は応答時に設定される
+}
+
+/* システムコールの処理(kz_reply(): 応答の送信) */
+static int thread_reply(kz_thread_id_t id, int size, char *p) {
+  kz_thread *thp = thread_get(id);
+  kz_thread *server = current;
+  kz_syscall_param_t *cp;
+
+  if ((thp == NULL) || !(thp->flags & KZ_THREAD_FLAG_REPLYWAIT)) {
+    // 応答を待っているスレッドではない(要求がまだ格納されていない場合も含む)
+    putcurrent();
+    return -1;
+  }
+
+  /* 応答を待っているスレッドに返す値を設定する */
+  thp->flags &= ~(KZ_THREAD_FLAG_CALLING | KZ_THREAD_FLAG_REPLYWAIT);
+  cp = thp->syscall.param;
+  cp->un.call.ret = size;
+  if (cp->un.call.rsizep) {
+    *(cp->un.call.rsizep) = size;
+  }
+  if (cp->un.call.rpp) {
+    *(cp->un.call.rpp) = p;
+  }
+
+  /*
+   * 同じ優先度の場合に呼び出し元が先に動作するように、呼び出し元を
+   * 先にレディーキューに繋いでから、呼び出し元に直接切り替える
+   */
+  current = thp;
+  putcurrent();
+  current = server;
+  putcurrent();
+  sethandoff(server, thp);
+
+  return 0;
+}
+#endif
+
+#if KZ_CONFIG_USE_MSGBOX_DYNAMIC
+/*
+ * システムコールの処理(kz_msgbox_create(): メッセージボックスの作成)
+ * 静的なメッセージボックスの後ろにある未使用のものを割り当てる
+ * (スロットは割り当て済みなので、メモリの獲得は不要)
+ */
+static kz_msgbox_id_t thread_msgbox_create(int limit) {
+  kz_msgbox *mboxp;
+  int i;
+
+  putcurrent();
+
+  if (limit < 0) {
+    return MSGBOX_ID_NONE; // 上限の指定が不正
+  }
+
+  for (i = MSGBOX_ID_NUM; i < MSGBOX_NUM; i++) {
+    if (!msgbox_state[i].used) {
+      break;
+    }
+  }
+  if (i == MSGBOX_NUM) {
+    return MSGBOX_ID_NONE;
+  }
+
+  mboxp = &msgboxes[i];
+  mboxp->count = 0;
+  mboxp->in = 0;
+  mboxp->out = 0;
+  mboxp->num = 0;
+  mboxp->limit = limit;
+#if KZ_CONFIG_USE_STATISTICS
+  memset(mboxp->stat, 0, sizeof(*mboxp->stat));
+#endif
+  msgbox_state[i].used = 1;
+
+  return (msgbox_state[i].gen << 8) | i;
+}
+#endif
+
+#if KZ_CONFIG_USE_STATISTICS
+/* システムコールの処理(kz_msgbox_stat(): メッセージボックスの統計情報の取得) */
+static int thread_msgboxstat(int index, kz_msgbox_stat_t *stat) {
+  kz_msgbox *mboxp;
+
+  putcurrent();
+
+  if ((index < 0) || (index >= MSGBOX_NUM)) {
+    return -1;
+  }
+  if (!msgbox_state[index].used) {
+    memset(stat, 0, sizeof(*stat));
+    return 0;
+  }
+  mboxp = &msgboxes[index];
+  memcpy(stat, mboxp->stat, sizeof(*stat));
+  stat->id = (msgbox_state[index].gen << 8) | index;
+  stat->depth = MSGBOX_DEPTH(mboxp);
+
+  return 1;
+}
+#endif
+
+#if KZ_CONFIG_USE_MSGBOX_DYNAMIC
+/* システムコールの処理(kz_msgbox_destroy(): メッセージボックスの削除) */
+static int thread_msgbox_destroy(kz_msgbox_id_t id) {
+  kz_msgbox *mboxp = msgbox_get(id);
+  int index = MSGBOX_ID_INDEX(id);
+
+  putcurrent();
+
+  if ((mboxp == NULL) || (index < MSGBOX_ID_NUM)) {
+    return -1; // 静的なメッセージボックスは削除できない
+  }
+  if (MSGBOX_DEPTH(mboxp) || mboxp->receivers || mboxp->senders) {
+    return -1; // 使用中
+  }
+
+  /* 世代番号を変えて、古いIDを無効にする(0は静的なもの用なので使わない) */
+  msgbox_state[index].used = 0;
+  msgbox_state[index].gen = (msgbox_state[index].gen + 1) & MSGBOX_ID_GEN_MASK;
+  if (!msgbox_state[index].gen) {
+    msgbox_state[index].gen = 1;
+  }
+
+  return 0;
+}
+#endif
+
+#if KZ_CONFIG_USE_RING
+/* 待っている消費者がいて、データが待っている数に達していれば起床させる */
+static int ring_wake(kz_ring *rp) {
+  kz_thread *save = current;
+  int count = kzring_count(&rp->ring);
+
+  if (!rp->waiter || (count < rp->want)) {
+    return 0;
+  }
+  current = rp->waiter;
+  rp->waiter = NULL;
+  current->syscall.param->un.ringwait.ret = count;
+  putcurrent();
+  current = save;
+
+  return 1;
+}
+
+/*
+ * システムコールの処理(kz_ring_wait(): リングバッファのデータを待つ)
+ * want バイト以上のデータがあればすぐに戻る。消費者は1つのスレッドに限る
+ */
+static int thread_ringwait(kz_ring_id_t id, int want) {
+  kz_ring *rp;
+  int count;
+
+  if ((id < 0) || (id >= RING_ID_NUM) || rings[id].waiter) {
+    putcurrent();
+    return -1;
+  }
+  rp = &rings[id];
+
+  if (want < 1) {
+    want = 1;
+  }
+  if (want > rp->ring.mask + 1) {
+    want = rp->ring.mask + 1;
+  }
+
+  count = kzring_count(&rp->ring);
+  if (count >= want) {
+    putcurrent();
+    return count;
+  }
+
+  /* データが足りないので、生産者が書き込むまでスリープする */
+  rp->waiter = current;
+  rp->want = want;
+
+  return -1; // 戻り値は起床時に設定される
+}
+
+/*
+ * システムコールの処理(kz_ring_write(), kx_ring_write(): リングバッファへの書き込み)
+ * 割込み処理からも呼ばれる(サービスコール)。メモリの獲得は行わない
+ */
+static int thread_ringwrite(kz_ring_id_t id, int size, char *p) {
+  kz_ring *rp;
+  int ret;
+
+  putcurrent();
+
+  if ((id < 0) || (id >= RING_ID_NUM)) {
+    return -1;
+  }
+  rp = &rings[id];
+
+  if (ring_record[id]) {
+    ret = kzring_putrec(&rp->ring, p, size);
+  } else {
+    ret = kzring_write(&rp->ring, p, size);
+  }
+  ring_wake(rp);
+
+  return ret;
+}
+
+/* リングバッファにバッファを割り当てる */
+static void ring_init(void) {
+  char *buf = ringbufs;
+  int i;
+
+  for (i = 0; i < RING_ID_NUM; i++) {
+    kzring_init(&rings[i].ring, buf, ring_size[i]);
+    rings[i].waiter = NULL;
+    buf += ring_size[i];
+  }
+}
+#endif
+
+#if KZ_CONFIG_USE_PIPE
+/* パイプIDからパイプを得る(不正なIDならば NULL) */
+static kz_pipe *pipe_get(kz_pipe_id_t id) {
+  if ((id < 0) || (id >= KZ_CONFIG_PIPE_NUM) || !pipes[id].used) {
+    return NULL;
+  }
+  return &pipes[id];
+}
+
+/* データがあれば、読み出し待ちのスレッドに読み出させて起床させる(起床させた数を返す) */
+static int pipe_wake_readers(kz_pipe *pp) {
+  kz_thread *save = current;
+  kz_syscall_param_t *p;
+  int num = 0;
+
+  while (pp->readers && kzring_count(&pp->ring)) {
+    current = pp->readers;
+    pp->readers = current->next;
+    current->next = NULL;
+    p = current->syscall.param;
+    p->un.pipe_rw.ret = kzring_read(&pp->ring, p->un.pipe_rw.p, p->un.pipe_rw.size);
+    putcurrent();
+    num++;
+  }
+  current = save;
+
+  return num;
+}
+
+/* 空きがあれば、書き込み待ちのスレッドに続きを書き込ませ、書き終えたら起床させる */
+static void pipe_wake_writers(kz_pipe *pp) {
+  kz_thread *save = current;
+  kz_syscall_param_t *p;
+  int size;
+
+  while (pp->writers && kzring_space(&pp->ring)) {
+    p = pp->writers->syscall.param;
+    size = kzring_write(&pp->ring, p->un.pipe_rw.p, p->un.pipe_rw.size);
+    p->un.pipe_rw.p += size;
+    p->un.pipe_rw.size -= size;
+    p->un.pipe_rw.done += size;
+    if (p->un.pipe_rw.size) {
+      break; // 一杯になったので、引き続き待つ
+    }
+    current = pp->writers;
+    pp->writers = current->next;
+    current->next = NULL;
+    p->un.pipe_rw.ret = p->un.pipe_rw.done;
+    putcurrent();
+  }
+  current = save;
+}
+
+/* 待っているスレッドの読み書きを、進まなくなるまで繰り返す */
+static void pipe_flush(kz_pipe *pp) {
+  do {
+    pipe_wake_writers(pp);
+  } while (pipe_wake_readers(pp));
+}
+
+/* システムコールの処理(kz_pipe_create(): パイプの作成) */
+static kz_pipe_id_t thread_pipe_create(void) {
+  int i;
+
+  putcurrent();
+
+  for (i = 0; i < KZ_CONFIG_PIPE_NUM; i++) {
+    if (!pipes[i].used) {
+      kzring_init(&pipes[i].ring, pipebufs + i * KZ_CONFIG_PIPE_SIZE, KZ_CONFIG_PIPE_SIZE);
+      pipes[i].readers = NULL;
+      pipes[i].writers = NULL;
+      pipes[i].used = 1;
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* システムコールの処理(kz_pipe_destroy(): パイプの削除) */
+static int thread_pipe_destroy(kz_pipe_id_t id) {
+  kz_pipe *pp = pipe_get(id);
+
+  putcurrent();
+
+  if ((pp == NULL) || pp->readers || pp->writers) {
+    return -1;
+  }
+  pp->used = 0;
+  return 0;
+}
+
+/* システムコールの処理(kz_pipe_read(): パイプからの読み出し) */
+static int thread_pipe_read(kz_pipe_id_t id, char *p, int size, int block) {
+  kz_pipe *pp = pipe_get(id);
+  int ret;
+
+  if (pp == NULL) {
+    putcurrent();
+    return -1;
+  }
+
+  if (!kzring_count(&pp->ring) && block && (size > 0)) {
+    /* データがないので、書き込まれるまでスリープする */
+    waitque_insert(&pp->readers, current);
+    return -1; // 戻り値は起床時に設定される
+  }
+
+  putcurrent();
+  ret = kzring_read(&pp->ring, p, size);
+  pipe_flush(pp); // 空きができたので、書き込み待ちのスレッドに書き込ませる
+
+  return ret;
+}
+
+/* システムコールの処理(kz_pipe_write(): パイプへの書き込み) */
+static int thread_pipe_write(kz_pipe_id_t id, char *p, int size, int block) {
+  kz_pipe *pp = pipe_get(id);
+  kz_syscall_param_t *pr = current->syscall.param;
+  kz_thread **thpp;
+  int ret;
+
+  if (pp == NULL) {
+    putcurrent();
+    return -1;
+  }
+
+  if (block && (size > 0)) {
+    /*
+     * 書き込み待ちのスレッドとして並び、書き込める分を書き込む
+     * 先頭のスレッドは書き込みの途中の場合があるので、優先度に関係なく
+     * 常に末尾に並べる(途中に割り込むと、書き込む内容が混ざってしまう)
+     * すべて書き込めた場合は、その時点でレディー状態になっている
+     */
+    pr->un.pipe_rw.p = p;
+    pr->un.pipe_rw.size = size;
+    pr->un.pipe_rw.done = 0;
+    thpp = &pp->writers;
+    while (*thpp) {
+      thpp = &(*thpp)->next;
+    }
+    current->next = NULL;
+    *thpp = current;
+    pipe_flush(pp);
+    if (current->flags & KZ_THREAD_FLAG_READY) {
+      return pr->un.pipe_rw.done;
+    }
+    return -1; // 戻り値は書き終えたときに設定される
+  }
+
+  /* ブロックしない場合は入る分だけ書き込む(書き込み待ちのスレッドがいれば書き込まない) */
+  putcurrent();
+  ret = pp->writers ? 0 : kzring_write(&pp->ring, p, size);
+  pipe_flush(pp);
+
+  return ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_TOPIC
+/* トピックIDからトピックを得る(不正なIDならば NULL) */
+static kz_topic *topic_get(kz_topic_id_t id) {
+  if ((id < 0) || (id >= KZ_CONFIG_TOPIC_NUM) || !topics[id].used) {
+    return NULL;
+  }
+  return &topics[id];
+}
+
+/* システムコールの処理(kz_topic_create(): トピックの作成) */
+static kz_topic_id_t thread_topic_create(void) {
+  int i;
+
+  putcurrent();
+
+  for (i = 0; i < KZ_CONFIG_TOPIC_NUM; i++) {
+    if (!topics[i].used) {
+      topics[i].used = 1;
+      topics[i].num = 0;
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* システムコールの処理(kz_topic_subscribe(): トピックの購読) */
+static int thread_topic_subscribe(kz_topic_id_t id, kz_msgbox_id_t mbox) {
+  kz_topic *tp = topic_get(id);
+  int i;
+
+  putcurrent();
+
+  if ((tp == NULL) || (msgbox_get(mbox) == NULL)) {
+    return -1;
+  }
+  for (i = 0; i < tp->num; i++) {
+    if (tp->subscribers[i] == mbox) {
+      return 0; // 購読済み
+    }
+  }
+  if (tp->num == KZ_CONFIG_TOPIC_SUBSCRIBERS) {
+    return -1;
+  }
+  tp->subscribers[tp->num++] = mbox;
+
+  return 0;
+}
+
+/* システムコールの処理(kz_topic_unsubscribe(): トピックの購読の終了) */
+static int thread_topic_unsubscribe(kz_topic_id_t id, kz_msgbox_id_t mbox) {
+  kz_topic *tp = topic_get(id);
+  int i;
+
+  putcurrent();
+
+  if (tp == NULL) {
+    return -1;
+  }
+  for (i = 0; i < tp->num; i++) {
+    if (tp->subscribers[i] == mbox) {
+      // 末尾のものを空いた位置に移す(配送の順序は保証しない)
+      tp->subscribers[i] = tp->subscribers[--tp->num];
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * システムコールの処理(kz_topic_publish(): メッセージの発行)
+ * 同じ領域を購読しているメッセージボックスのすべてに送信して、配送した数を
+ * 参照カウントに設定する。一杯のメッセージボックスと、メッセージバッファを
+ * 獲得できなかったメッセージボックスには配送しない(ブロックしない)
+ * 領域の所有権は常に移るので、配送先がなければここで解放する
+ */
+static int thread_topic_publish(kz_topic_id_t id, int size, char *p) {
+  kz_topic *tp = topic_get(id);
+  kz_topicbuf *bp;
+  kz_thread *thp = current;
+  kz_msgbox *mboxp;
+  int i, num = 0;
+
+  putcurrent();
+
+  if (p == NULL) {
+    return -1; // kz_topic_alloc() で獲得できなかった領域
+  }
+  bp = (kz_topicbuf *)p - 1;
+
+  if (tp) {
+    for (i = 0; i < tp->num; i++) {
+      mboxp = msgbox_get(tp->subscribers[i]);
+      if ((mboxp == NULL) || (mboxp->limit && (mboxp->num >= mboxp->limit))) {
+        continue; // 削除されたか一杯
+      }
+      if (sendmsg(mboxp, thp, size, p, 0) < 0) {
+        continue; // メッセージバッファを獲得できない
+      }
+      wakereceiver(mboxp);
+      current = thp;
+      num++;
+    }
+  }
+
+  bp->refs = num;
+  if (!num) {
+    kzmem_free(bp);
+  }
+
+  return tp ? num : -1;
+}
+
+/* システムコールの処理(kz_topic_release(): 発行されたメッセージの解放) */
+static int thread_topic_release(char *p) {
+  kz_topicbuf *bp;
+
+  putcurrent();
+
+  if (p == NULL) {
+    return -1;
+  }
+  bp = (kz_topicbuf *)p - 1;
+
+  if (--bp->refs <= 0) {
+    kzmem_free(bp); // 最後の配送先が解放した
+  }
+
+  return 0;
+}
+#endif
+
+/* システムコールの処理(kz_setintr(), kz_setintr_fast(): 割込みハンドラの登録) */
+static int thread_setintr(softvec_type_t type, kz_handler_t handler, kz_fasthandler_t fasthandler) {
+  static void thread_intr(softvec_type_t type, unsigned long sp);
+
+  /*
+  * 割込みを受け付けるために、ソフトウェア割込みベクタに
+  * OSの割込み処理の入り口となる関数を登録する
+  */
+  softvec_setintr(type, thread_intr);
+
+  handlers[type] = handler;
+  fasthandlers[type] = fasthandler;
+
+  putcurrent();
+  return 0;
+}
+
+#if KZ_CONFIG_USE_WORKPOOL
+/* ジョブをワーカスレッドに渡す */
+static void jobget(kz_thread *thp, kz_job_t *job) {
+  kz_syscall_param_t *p;
+
+  /* ジョブを取得するスレッドに返す値を設定する */
+  p = thp->syscall.param;
+  memcpy(p->un.jobget.job, job, sizeof(*job));
+  p->un.jobget.ret = 0;
+}
+
+/* システムコールの処理(kz_job_post(): ジョブの投入) */
+static int thread_jobpost(kz_job_func_t func, void *arg, kz_msgbox_id_t notify) {
+  kz_job_t job;
+  kz_job *jp;
+
+  job.func = func;
+  job.arg = arg;
+  job.notify = notify;
+
+  putcurrent();
+  workpool.stat.posted++;
+
+  if (workpool.idle) {
+    /*
+     * ジョブ待ちのワーカスレッドがいる場合には、キューを経由せずに
+     * 直接ジョブを渡す(メモリの獲得は不要)
+     */
+    current = workpool.idle;
+    workpool.idle = current->next;
+    current->next = NULL;
+    workpool.stat.idle--;
+    jobget(current, &job);
+    putcurrent(); // ジョブを受け取ったので、ブロック解除する
+    return 0;
+  }
+
+  jp = (kz_job *)kzmem_alloc(sizeof(*jp));
+  if (jp == NULL) {
+    workpool.stat.posted--; // キューに繋げないので、投入しなかったことにする
+    return -1;
+  }
+  jp->next = NULL;
+  memcpy(&jp->job, &job, sizeof(job));
+
+  /* ジョブキューの末尾に接続する */
+  if (workpool.tail) {
+    workpool.tail->next = jp;
+  } else {
+    workpool.head = jp;
+  }
+  workpool.tail = jp;
+
+  if (++workpool.stat.queued > workpool.stat.peak) {
+    workpool.stat.peak = workpool.stat.queued;
+  }
+
+  return 0;
+}
+
+/* システムコールの処理(kz_job_get(): ジョブの取得) */
+static int thread_jobget(kz_job_t *job) {
+  kz_job *jp;
+
+  if (!(current->flags & KZ_THREAD_FLAG_WORKER)) {
+    current->flags |= KZ_THREAD_FLAG_WORKER;
+    workpool.stat.workers++;
+  }
+
+  if (workpool.head == NULL) {
+    /*
+     * ジョブがないので、ジョブ待ちのワーカスレッドとして登録して
+     * スリープさせる(システムコールをブロックする)
+     */
+    current->next = workpool.idle;
+    workpool.idle = current;
+    workpool.stat.idle++;
+    return -1;
+  }
+
+  /* ジョブキューの先頭にあるジョブを抜き出す */
+  jp = workpool.head;
+  workpool.head = jp->next;
+  if (workpool.head == NULL) {
+    workpool.tail = NULL;
+  }
+  workpool.stat.queued--;
+
+  jobget(current, &jp->job);
+  kzmem_free(jp);
+  putcurrent();
+
+  return 0;
+}
+
+/* システムコールの処理(kz_job_done(): ジョブの完了通知) */
+static int thread_jobdone(kz_job_t *job, int result) {
+  workpool.stat.done++;
+
+  /*
+   * 完了通知先が指定されていれば、結果と引数をメッセージとして送信する
+   * (パラメータ領域が kz_send() と異なるので、一杯でもブロックしない)
+   */
+  if (job->notify != MSGBOX_ID_NONE) {
+    return (thread_send(job->notify, result, job->arg, 0) < 0) ? -1 : 0;
+  }
+
+  putcurrent();
+  return 0;
+}
+
+#if KZ_CONFIG_USE_STATISTICS
+/* システムコールの処理(kz_job_stat(): ワーカスレッドプールの統計情報の取得) */
+static int thread_jobstat(kz_jobstat_t *stat) {
+  memcpy(stat, &workpool.stat, sizeof(*stat));
+  putcurrent();
+  return 0;
+}
+#endif
+#endif
+
+#if KZ_CONFIG_USE_PERIODIC
+/* システムコールの処理(kz_setperiod(): 周期の設定) */
+static int thread_setperiod(int msec) {
+  /*
+   * システムティックは1ミリ秒なので、周期のティック数はミリ秒と同じになる
+   * 最初のリリース時刻は、現在時刻から1周期後とする
+   */
+  current->period.interval = msec;
+  current->period.release = kinfo.ticks + msec;
+  current->period.releases = 0;
+  current->period.overruns = 0;
+  current->period.jitter = 0;
+  current->period.jitter_max = 0;
+  putcurrent();
+  return 0;
+}
+
+#if KZ_CONFIG_USE_STATISTICS
+/* ティック数をマイクロ秒に変換する(32ビットの乗算にならないように、シフトと加算で求める) */
+static uint32 tick_to_usec(unsigned int ticks) {
+  uint32 usec = 0, unit = TIMER_TICK_USEC;
+
+  for (; ticks; ticks >>= 1, unit <<= 1) {
+    if (ticks & 1) {
+      usec += unit;
+    }
+  }
+  return usec;
+}
+#endif
+
+/* システムコールの処理(kz_wait_next_period(): 次の周期まで待つ) */
+static int thread_waitperiod(void) {
+  kz_thread **thpp;
+  int overruns = 0;
+
+  if (!current->period.interval) {
+    putcurrent();
+    return -1;
+  }
+
+  if ((long)(kinfo.ticks - current->period.release) >= 0) {
+    /*
+     * 次のリリース時刻を既に過ぎている(オーバーラン)ので、ブロックせずに
+     * すぐに戻る。複数の周期を過ぎている場合は、まとめて読み飛ばす
+     * (リリース時刻は常に周期の整数倍で進めるので、ドリフトしない)
+     */
+    do {
+      current->period.release += current->period.interval;
+      current->period.overruns++;
+      overruns++;
+    } while ((long)(kinfo.ticks - current->period.release) >= 0);
+    current->period.releases++;
+#if KZ_CONFIG_USE_STATISTICS
+    /*
+     * 読み飛ばした最後のリリース時刻を理想的なリリース時刻として、そこから
+     * 実行再開までの遅れもジッタに記録する(遅れは1周期未満なので int に収まる)
+     */
+    current->period.release_usec = kinfo.tick_usec -
+      tick_to_usec(kinfo.ticks - (current->period.release - current->period.interval));
+    current->flags |= KZ_THREAD_FLAG_RELEASED;
+#endif
+    putcurrent();
+    return overruns;
+  }
+
+  /* リリース時刻の順に並ぶように、周期待ちのキューに挿入する */
+  for (thpp = &periodque; *thpp; thpp = &(*thpp)->next) {
+    if ((long)((*thpp)->period.release - current->period.release) > 0) {
+      break;
+    }
+  }
+  current->next = *thpp;
+  *thpp = current;
+
+  return 0;
+}
+
+/* 周期待ちのスレッドのうち、リリース時刻になったものをレディー状態にする */
+static int period_release(void) {
+  kz_thread *thp;
+  int released = 0;
+
+  while (periodque && ((long)(kinfo.ticks - periodque->period.release) >= 0)) {
+    thp = periodque;
+    periodque = thp->next;
+    thp->next = NULL;
+
+    thp->period.release += thp->period.interval;
+    thp->period.release_usec = kinfo.tick_usec; // 理想的なリリース時刻(ティックの時刻)
+    thp->period.releases++;
+    thp->flags |= KZ_THREAD_FLAG_RELEASED;
+
+    current = thp;
+    putcurrent();
+    released = 1;
+  }
+
+  return released;
+}
+#endif
+
+#if KZ_CONFIG_USE_STATISTICS
+/* システムコールの処理(kz_thread_stat(): スレッドの情報の取得) */
+static int thread_threadstat(int index, kz_thread_stat_t *stat) {
+  kz_thread *thp;
+
+  putcurrent();
+
+  if ((index < 0) || (index >= THREAD_NUM)) {
+    return -1;
+  }
+  thp = &threads[index];
+  memset(stat, 0, sizeof(*stat));
+  if (!thp->init.func) {
+    // 未使用のTCB
+    return 0;
+  }
+
+  stat->id = (kz_thread_id_t)thp;
+  strcpy(stat->name, thp->name);
+  stat->priority = thp->priority;
+#if KZ_CONFIG_USE_PERIODIC
+  stat->period = thp->period.interval;
+  stat->releases = thp->period.releases;
+  stat->overruns = thp->period.overruns;
+  stat->jitter = thp->period.jitter;
+  stat->jitter_max = thp->period.jitter_max;
+#endif
+#if KZ_CONFIG_USE_BUDGET
+  stat->budget = thp->budget.budget;
+  stat->used = thp->budget.used;
+  stat->exhausted = thp->budget.exhausted;
+#endif
+
+  return 1;
+}
+#endif
+
+#if KZ_CONFIG_USE_SWTIMER
+/* システムコールの処理(kz_timer_create(): ソフトウェアタイマの生成) */
+static kz_timer_id_t thread_timercreate(kz_timer_func_t func, void *arg) {
+  putcurrent();
+  return kztimer_create(func, arg);
+}
+
+/* システムコールの処理(kz_timer_start(): ソフトウェアタイマの開始) */
+static int thread_timerstart(kz_timer_id_t id, int msec, int interval) {
+  putcurrent();
+  return kztimer_start(id, msec, interval);
+}
+
+/* システムコールの処理(kz_timer_stop(): ソフトウェアタイマの停止) */
+static int thread_timerstop(kz_timer_id_t id) {
+  putcurrent();
+  return kztimer_stop(id);
+}
+#endif
+
+#if KZ_CONFIG_USE_BUDGET
+/* システムコールの処理(kz_setbudget(): 実行時間の制限の設定) */
+static int thread_setbudget(uint32 budget, int msec) {
+  if (current->flags & KZ_THREAD_FLAG_DEMOTED) {
+    // 本来の優先度に戻してから設定し直す
+    current->priority = current->budget.priority;
+    current->flags &= ~KZ_THREAD_FLAG_DEMOTED;
+  }
+
+  if (budget && (msec > 0)) {
+    if (!current->budget.budget) {
+      budget_num++;
+    }
+    current->budget.budget = budget;
+    current->budget.used = 0;
+    current->budget.start = kz_gettime();
+    current->budget.interval = msec; // システムティックは1ミリ秒
+    current->budget.replenish = kinfo.ticks + msec;
+    current->budget.exhausted = 0;
+    current->budget.priority = current->priority;
+  } else {
+    if (current->budget.budget) {
+      budget_num--;
+    }
+    current->budget.budget = 0;
+  }
+
+  putcurrent();
+  return 0;
+}
+
+/*
+ * 割込まれたスレッドの実行時間を加算する
+ * (実行時間を使い切った場合は1を返す)
+ */
+static int budget_charge(kz_thread *thp) {
+  uint32 now;
+
+  if (!thp->budget.budget) {
+    return 0;
+  }
+
+  now = kz_gettime();
+  if (thp->flags & KZ_THREAD_FLAG_DEMOTED) {
+    // 優先度を下げている間の実行時間は加算しない
+    thp->budget.start = now;
+    return 0;
+  }
+  thp->budget.used += now - thp->budget.start;
+  thp->budget.start = now;
+
+  return (thp->budget.used >= thp->budget.budget) ? 1 : 0;
+}
+
+/* 実行時間を使い切ったスレッドを、次の補充まで低い優先度に下げる */
+static void budget_demote(kz_thread *thp) {
+  if (!thp->budget.budget || (thp->flags & KZ_THREAD_FLAG_DEMOTED)) {
+    return;
+  }
+  thp->budget.exhausted++;
+  thp->flags |= KZ_THREAD_FLAG_DEMOTED;
+  thread_changepri(thp, BUDGET_PRIORITY);
+}
+
+/* 補充時刻になったスレッドの実行時間を補充し、優先度を元に戻す */
+static int budget_replenish(void) {
+  kz_thread *thp;
+  int i, changed = 0;
+
+  if (!budget_num) {
+    return 0;
+  }
+
+  for (i = 0; i < THREAD_NUM; i++) {
+    thp = &threads[i];
+    if (!thp->budget.budget) {
+      continue;
+    }
+    if ((long)(kinfo.ticks - thp->budget.replenish) < 0) {
+      continue;
+    }
+    thp->budget.replenish += thp->budget.interval;
+    thp->budget.used = 0;
+    if (thp->flags & KZ_THREAD_FLAG_DEMOTED) {
+      thp->flags &= ~KZ_THREAD_FLAG_DEMOTED;
+      thread_changepri(thp, thp->budget.priority);
+      changed = 1;
+    }
+  }
+
+  return changed;
+}
+#endif
+
+#if KZ_CONFIG_USE_BATCH
+static int call_functions(kz_syscall_type_t type, kz_syscall_param_t *p);
+
+/*
+ * 送信のシステムコールが失敗したか
+ * (送信系のパラメータは先頭が send と同じ並びなので、send として参照する)
+ */
+static int batch_sendfail(kz_batch_t *op) {
+  switch (op->type) {
+    case KZ_SYSCALL_TYPE_SEND:
+    case KZ_SYSCALL_TYPE_TRYSEND:
+#if KZ_CONFIG_USE_MSGPRI
+    case KZ_SYSCALL_TYPE_SENDPRI:
+#endif
+#if KZ_CONFIG_USE_SENDV
+    case KZ_SYSCALL_TYPE_SENDV:
+#endif
+      return op->param.un.send.ret < 0;
+    default:
+      return 0;
+  }
+}
+
+/*
+ * システムコールの処理(kz_batch(): システムコールの一括発行)
+ * 1回のトラップで複数のシステムコールを順に処理する。ブロックする
+ * システムコールがあった場合はそこで処理を止め、スレッドはブロックされる
+ * (戻り値は起床時に、ブロックしたシステムコールのパラメータ領域に格納される)
+ * 送信に失敗した場合もそこで止める。処理したシステムコールの数を返す
+ */
+static int thread_batch(kz_batch_t *ops, int num) {
+  kz_thread *thp = current;
+  kz_batch_t *op;
+  int i;
+
+  if (thp == NULL) {
+    // サービスコールからは呼べない
+    return -1;
+  }
+
+  /* 配列のインデックス計算で乗算を使わないように、ポインタを進めて処理する */
+  for (i = 0, op = ops; i < num; i++, op++) {
+    if ((op->type == KZ_SYSCALL_TYPE_EXIT) || (op->type == KZ_SYSCALL_TYPE_BATCH)) {
+      // スレッドの終了と入れ子の一括発行はできない
+      break;
+    }
+
+    /*
+     * ブロックした場合に起床時の戻り値が格納されるように、パラメータ領域を
+     * 差し替えてから処理関数を呼び出す(処理中に current が書き換わるので戻す)
+     */
+    thp->syscall.param = &op->param;
+    current = thp;
+    /*
+     * 直接切り替え(kz_reply() など)は、その後の処理でレディー状態のスレッドが
+     * 変わると schedule() と同じ結果にならないので、最後の処理のものだけを有効にする
+     */
+    handoff = NULL;
+    if (call_functions(op->type, &op->param) < 0) {
+      // 未定義のシステムコール
+      break;
+    }
+    current = thp;
+
+    if (!(thp->flags & KZ_THREAD_FLAG_READY)) {
+      // ブロックしたので、ここで止める
+      return i + 1;
+    }
+    if (batch_sendfail(op)) {
+      // 送信に失敗したので、後続の受信で応答を待ち続けないようにここで止める
+      return i + 1;
+    }
+    // 次のシステムコールのために、再びレディーキューから外す
+    readyque_remove(thp);
+  }
+
+  putcurrent();
+  return i;
+}
+#endif
+
+/*
+ * システムコールごとの処理関数の呼び出し
+ * (パラメータ領域から引数を取り出し、戻り値を書き込む)
+ */
+static void syscall_run(kz_syscall_param_t *p) {
+  p->un.run.ret = thread_run(
+    p->un.run.func, p->un.run.name,
+    p->un.run.priority, p->un.run.stacksize,
+    p->un.run.argc, p->un.run.argv
+  );
+}
+
+static void syscall_exit(kz_syscall_param_t *p) {
+  /* TCBが消去されるので戻り値を書き込んではいけない */
+  thread_exit();
+}
+
+static void syscall_wait(kz_syscall_param_t *p) {
+  p->un.wait.ret = thread_wait();
+}
+
+static void syscall_sleep(kz_syscall_param_t *p) {
+  p->un.sleep.ret = thread_sleep();
+}
+
+static void syscall_wakeup(kz_syscall_param_t *p) {
+  p->un.wakeup.ret = thread_wakeup(p->un.wakeup.id);
+}
+
+static void syscall_getid(kz_syscall_param_t *p) {
+  p->un.getid.ret = thread_getid();
+}
+
+static void syscall_chpri(kz_syscall_param_t *p) {
+  p->un.chpri.ret = thread_chpri(p->un.chpri.priority);
+}
+
+static void syscall_kmalloc(kz_syscall_param_t *p) {
+  p->un.kmalloc.ret = thread_kmalloc(p->un.kmalloc.size);
+}
+
+static void syscall_kmfree(kz_syscall_param_t *p) {
+  p->un.kmfree.ret = thread_kmfree(p->un.kmfree.p);
+}
+
+static void syscall_send(kz_syscall_param_t *p) {
+  p->un.send.ret = thread_send(p->un.send.id, p->un.send.size, p->un.send.p, 1);
+}
+
+#if KZ_CONFIG_USE_PIPE
+static void syscall_pipe_create(kz_syscall_param_t *p) {
+  p->un.pipe_create.ret = thread_pipe_create();
+}
+
+static void syscall_pipe_destroy(kz_syscall_param_t *p) {
+  p->un.pipe_destroy.ret = thread_pipe_destroy(p->un.pipe_destroy.id);
+}
+
+static void syscall_pipe_read(kz_syscall_param_t *p) {
+  p->un.pipe_rw.ret = thread_pipe_read(p->un.pipe_rw.id, p->un.pipe_rw.p, p->un.pipe_rw.size, p->un.pipe_rw.block);
+}
+
+static void syscall_pipe_write(kz_syscall_param_t *p) {
+  p->un.pipe_rw.ret = thread_pipe_write(p->un.pipe_rw.id, p->un.pipe_rw.p, p->un.pipe_rw.size, p->un.pipe_rw.block);
+}
+#endif
+
+#if KZ_CONFIG_USE_TOPIC
+static void syscall_topic_create(kz_syscall_param_t *p) {
+  p->un.topic_create.ret = thread_topic_create();
+}
+
+static void syscall_topic_subscribe(kz_syscall_param_t *p) {
+  p->un.topic_subscribe.ret = thread_topic_subscribe(p->un.topic_subscribe.id, p->un.topic_subscribe.mbox);
+}
+
+static void syscall_topic_unsubscribe(kz_syscall_param_t *p) {
+  p->un.topic_subscribe.ret = thread_topic_unsubscribe(p->un.topic_subscribe.id, p->un.topic_subscribe.mbox);
+}
+
+static void syscall_topic_publish(kz_syscall_param_t *p) {
+  p->un.topic_publish.ret = thread_topic_publish(p->un.topic_publish.id, p->un.topic_publish.size, p->un.topic_publish.p);
+}
+
+static void syscall_topic_release(kz_syscall_param_t *p) {
+  p->un.topic_release.ret = thread_topic_release(p->un.topic_release.p);
+}
+#endif
+
+#if KZ_CONFIG_USE_INBOX
+static void syscall_send_thread(kz_syscall_param_t *p) {
+  p->un.send_thread.ret = thread_send_thread(p->un.send_thread.id, p->un.send_thread.size, p->un.send_thread.p);
+}
+
+static void syscall_recv_self(kz_syscall_param_t *p) {
+  p->un.recv.ret = thread_recv_self();
+}
+#endif
+
+#if KZ_CONFIG_USE_MSGPRI
+static void syscall_sendpri(kz_syscall_param_t *p) {
+  p->un.sendpri.ret = thread_sendpri(p->un.sendpri.id, p->un.sendpri.size, p->un.sendpri.p, p->un.sendpri.priority);
+}
+#endif
+
+#if KZ_CONFIG_USE_RING
+static void syscall_ringwait(kz_syscall_param_t *p) {
+  p->un.ringwait.ret = thread_ringwait(p->un.ringwait.id, p->un.ringwait.want);
+}
+
+static void syscall_ringwrite(kz_syscall_param_t *p) {
+  p->un.ringwrite.ret = thread_ringwrite(p->un.ringwrite.id, p->un.ringwrite.size, p->un.ringwrite.p);
+}
+#endif
+
+#if KZ_CONFIG_USE_MSGBOX_DYNAMIC
+static void syscall_msgbox_create(kz_syscall_param_t *p) {
+  p->un.msgbox_create.ret = thread_msgbox_create(p->un.msgbox_create.limit);
+}
+
+static void syscall_msgbox_destroy(kz_syscall_param_t *p) {
+  p->un.msgbox_destroy.ret = thread_msgbox_destroy(p->un.msgbox_destroy.id);
+}
+#endif
+
+#if KZ_CONFIG_USE_SENDV
+static void syscall_sendv(kz_syscall_param_t *p) {
+  p->un.sendv.ret = thread_sendv(p->un.sendv.id, p->un.sendv.iov, p->un.sendv.iovcnt);
+}
+
+static void syscall_recvv(kz_syscall_param_t *p) {
+  current->flags |= KZ_THREAD_FLAG_VECTOR; // 受信処理でセグメントの配列として返す
+  p->un.recvv.ret = thread_recv(p->un.recvv.id, p->un.recvv.iovcntp, p->un.recvv.pp);
+}
+#endif
+
+#if KZ_CONFIG_USE_CALL
+static void syscall_call(kz_syscall_param_t *p) {
+  p->un.call.ret = thread_call(p->un.call.id, p->un.call.size, p->un.call.p);
+}
+
+static void syscall_reply(kz_syscall_param_t *p) {
+  p->un.reply.ret = thread_reply(p->un.reply.id, p->un.reply.size, p->un.reply.p);
+}
+#endif
+
+static void syscall_trysend(kz_syscall_param_t *p) {
+  p->un.send.ret = thread_send(p->un.send.id, p->un.send.size, p->un.send.p, 0);
+}
+
+static void syscall_recv(kz_syscall_param_t *p) {
+  p->un.recv.ret = thread_recv(p->un.recv.id, p->un.recv.sizep, p->un.recv.pp);
+}
+
+static void syscall_setintr(kz_syscall_param_t *p) {
+  p->un.setintr.ret = thread_setintr(p->un.setintr.type, p->un.setintr.handler, p->un.setintr.fasthandler);
+}
+
+#if KZ_CONFIG_USE_BATCH
+static void syscall_batch(kz_syscall_param_t *p) {
+  p->un.batch.ret = thread_batch(p->un.batch.ops, p->un.batch.num);
+}
+#endif
+
+#if KZ_CONFIG_USE_WORKPOOL
+static void syscall_jobpost(kz_syscall_param_t *p) {
+  p->un.jobpost.ret = thread_jobpost(p->un.jobpost.func, p->un.jobpost.arg, p->un.jobpost.notify);
+}
+
+static void syscall_jobget(kz_syscall_param_t *p) {
+  p->un.jobget.ret = thread_jobget(p->un.jobget.job);
+}
+
+static void syscall_jobdone(kz_syscall_param_t *p) {
+  p->un.jobdone.ret = thread_jobdone(p->un.jobdone.job, p->un.jobdone.result);
+}
+
+#if KZ_CONFIG_USE_STATISTICS
+static void syscall_jobstat(kz_syscall_param_t *p) {
+  p->un.jobstat.ret = thread_jobstat(p->un.jobstat.stat);
+}
+#endif
+#endif
+
+#if KZ_CONFIG_USE_PERIODIC
+static void syscall_setperiod(kz_syscall_param_t *p) {
+  p->un.setperiod.ret = thread_setperiod(p->un.setperiod.msec);
+}
+
+static void syscall_waitperiod(kz_syscall_param_t *p) {
+  p->un.waitperiod.ret = thread_waitperiod();
+}
+#endif
+
+#if KZ_CONFIG_USE_STATISTICS
+static void syscall_msgboxstat(kz_syscall_param_t *p) {
+  p->un.msgboxstat.ret = thread_msgboxstat(p->un.msgboxstat.index, p->un.msgboxstat.stat);
+}
+
+static void syscall_threadstat(kz_syscall_param_t *p) {
+  p->un.threadstat.ret = thread_threadstat(p->un.threadstat.index, p->un.threadstat.stat);
+}
+#endif
+
+#if KZ_CONFIG_USE_SWTIMER
+static void syscall_timercreate(kz_syscall_param_t *p) {
+  p->un.timercreate.ret = thread_timercreate(p->un.timercreate.func, p->un.timercreate.arg);
+}
+
+static void syscall_timerstart(kz_syscall_param_t *p) {
+  p->un.timerstart.ret = thread_timerstart(p->un.timerstart.id, p->un.timerstart.msec, p->un.timerstart.interval);
+}
+
+static void syscall_timerstop(kz_syscall_param_t *p) {
+  p->un.timerstop.ret = thread_timerstop(p->un.timerstop.id);
+}
+#endif
+
+#if KZ_CONFIG_USE_BUDGET
+static void syscall_setbudget(kz_syscall_param_t *p) {
+  p->un.setbudget.ret = thread_setbudget(p->un.setbudget.budget, p->un.setbudget.msec);
+}
+#endif
+
+/*
+ * システムコールのディスパッチテーブル
+ * 構成で削除されたシステムコールのエントリは NULL になる
+ */
+typedef void (*kz_syscall_func_t)(kz_syscall_param_t *p);
+
+static const kz_syscall_func_t syscall_table[KZ_SYSCALL_TYPE_NUM] = {
+  [KZ_SYSCALL_TYPE_RUN] = syscall_run,
+  [KZ_SYSCALL_TYPE_EXIT] = syscall_exit,
+  [KZ_SYSCALL_TYPE_WAIT] = syscall_wait,
+  [KZ_SYSCALL_TYPE_SLEEP] = syscall_sleep,
+  [KZ_SYSCALL_TYPE_WAKEUP] = syscall_wakeup,
+  [KZ_SYSCALL_TYPE_GETID] = syscall_getid,
+  [KZ_SYSCALL_TYPE_CHPRI] = syscall_chpri,
+  [KZ_SYSCALL_TYPE_KMALLOC] = syscall_kmalloc,
+  [KZ_SYSCALL_TYPE_KMFREE] = syscall_kmfree,
+  [KZ_SYSCALL_TYPE_SEND] = syscall_send,
+  [KZ_SYSCALL_TYPE_TRYSEND] = syscall_trysend,
+#if KZ_CONFIG_USE_CALL
+  [KZ_SYSCALL_TYPE_CALL] = syscall_call,
+  [KZ_SYSCALL_TYPE_REPLY] = syscall_reply,
+#endif
+#if KZ_CONFIG_USE_SENDV
+  [KZ_SYSCALL_TYPE_SENDV] = syscall_sendv,
+  [KZ_SYSCALL_TYPE_RECVV] = syscall_recvv,
+#endif
+#if KZ_CONFIG_USE_RING
+  [KZ_SYSCALL_TYPE_RINGWAIT] = syscall_ringwait,
+  [KZ_SYSCALL_TYPE_RINGWRITE] = syscall_ringwrite,
+#endif
+#if KZ_CONFIG_USE_MSGBOX_DYNAMIC
+  [KZ_SYSCALL_TYPE_MSGBOX_CREATE] = syscall_msgbox_create,
+  [KZ_SYSCALL_TYPE_MSGBOX_DESTROY] = syscall_msgbox_destroy,
+#endif
+#if KZ_CONFIG_USE_MSGPRI
+  [KZ_SYSCALL_TYPE_SENDPRI] = syscall_sendpri,
+#endif
+#if KZ_CONFIG_USE_INBOX
+  [KZ_SYSCALL_TYPE_SEND_THREAD] = syscall_send_thread,
+  [KZ_SYSCALL_TYPE_RECV_SELF] = syscall_recv_self,
+#endif
+  [KZ_SYSCALL_TYPE_RECV] = syscall_recv,
+  [KZ_SYSCALL_TYPE_SETINTR] = syscall_setintr,
+#if KZ_CONFIG_USE_BATCH
+  [KZ_SYSCALL_TYPE_BATCH] = syscall_batch,
+#endif
+#if KZ_CONFIG_USE_WORKPOOL
+  [KZ_SYSCALL_TYPE_JOBPOST] = syscall_jobpost,
+  [KZ_SYSCALL_TYPE_JOBGET] = syscall_jobget,
+  [KZ_SYSCALL_TYPE_JOBDONE] = syscall_jobdone,
+#if KZ_CONFIG_USE_STATISTICS
+  [KZ_SYSCALL_TYPE_JOBSTAT] = syscall_jobstat,
+#endif
+#endif
+#if KZ_CONFIG_USE_PERIODIC
+  [KZ_SYSCALL_TYPE_SETPERIOD] = syscall_setperiod,
+  [KZ_SYSCALL_TYPE_WAITPERIOD] = syscall_waitperiod,
+#endif
+#if KZ_CONFIG_USE_STATISTICS
+  [KZ_SYSCALL_TYPE_THREADSTAT] = syscall_threadstat,
+  [KZ_SYSCALL_TYPE_MSGBOXSTAT] = syscall_msgboxstat,
+#endif
+#if KZ_CONFIG_USE_SWTIMER
+  [KZ_SYSCALL_TYPE_TIMERCREATE] = syscall_timercreate,
+  [KZ_SYSCALL_TYPE_TIMERSTART] = syscall_timerstart,
+  [KZ_SYSCALL_TYPE_TIMERSTOP] = syscall_timerstop,
+#endif
+#if KZ_CONFIG_USE_BUDGET
+  [KZ_SYSCALL_TYPE_SETBUDGET] = syscall_setbudget,
+#endif
+#if KZ_CONFIG_USE_PIPE
+  [KZ_SYSCALL_TYPE_PIPE_CREATE] = syscall_pipe_create,
+  [KZ_SYSCALL_TYPE_PIPE_DESTROY] = syscall_pipe_destroy,
+  [KZ_SYSCALL_TYPE_PIPE_READ] = syscall_pipe_read,
+  [KZ_SYSCALL_TYPE_PIPE_WRITE] = syscall_pipe_write,
+#endif
+#if KZ_CONFIG_USE_TOPIC
+  [KZ_SYSCALL_TYPE_TOPIC_CREATE] = syscall_topic_create,
+  [KZ_SYSCALL_TYPE_TOPIC_SUBSCRIBE] = syscall_topic_subscribe,
+  [KZ_SYSCALL_TYPE_TOPIC_UNSUBSCRIBE] = syscall_topic_unsubscribe,
+  [KZ_SYSCALL_TYPE_TOPIC_PUBLISH] = syscall_topic_publish,
+  [KZ_SYSCALL_TYPE_TOPIC_RELEASE] = syscall_topic_release,
+#endif
+};
+
+static int call_functions(kz_syscall_type_t type, kz_syscall_param_t *p) {
+  /* システムコールの実行中に current が書き換わるので注意 */
+  if (((unsigned int)type >= KZ_SYSCALL_TYPE_NUM) || !syscall_table[type]) {
+    return -1;
+  }
+  syscall_table[type](p);
+  return 0;
+}
+
+/* システムコールの処理 */
+static void syscall_proc(kz_syscall_type_t type, kz_syscall_param_t *p) {
+  /*
+  * システムコールを呼び出したスレッドをレディーキューから
+  * 外した状態で処理関数を呼び出す。このためシステムコールを
+  * 呼び出したスレッドをそのまま動作継続させたいばあいには、
+  * 処理関数の内部で putcurrent() を行う必要がある
+  */
+  kinfo.syscalls++;
+  getcurrent(); // カレントスレッドをレディーキューから外す
+  call_functions(type, p); // システムコールの処理関数を呼び出す
+}
+
+/* サービスコールの処理 */
+static void srvcall_proc(kz_syscall_type_t type, kz_syscall_param_t *p) {
+  /*
+  * システムコールとサービスコールの処理関数の内部で
+  * システムコールの実行したスレッドIDを得るために current を
+  * 参照している部分があり(たとえば thread_send() など)、
+  * current が残っていると誤動作するため NULL に設定する。
+  * サービスコールは thread_intrvec() 内部の割込みハンドラ呼び出しの
+  * 延長で呼ばれているはずなので、呼び出し後に thread_intrvec() で
+  * スケジューリング処理が行われ、 curret は再設定される
+  */
+  current = NULL;
+  call_functions(type, p);
+}
+
+/* スレッドのスケジューリング */
+static void schedule(void) {
+  int i;
+  /*
+  * 優先順位の高い順(優先度の数値の小さい順)にレディーキューを見て、
+  * 動作可能なスレッドを検索する
+  */
+  for (i = 0; i < PRIORITY_NUM; i++) {
+    if (readyque[i].head) {
+      break;
+    }
+  }
+  if (i == PRIORITY_NUM) {
+    kz_sysdown();
+  }
+  current = readyque[i].head;
+}
+
+// システムコールの呼び出し
+static void syscall_intr(void) {
+  syscall_proc(current->syscall.type, current->syscall.param);
+}
+
+static void softerr_intr(void) {
+  // ソフトウェアエラーが発生し場合は、スレッドを強制終了する
+  puts(current->name);
+  puts(" DOWN.\n");
+  getcurrent();
+  thread_exit();
+}
+
+/*
+ * システムティックの割込みハンドラ(高速割込みハンドラとして登録する)
+ * 時刻情報を進め、周期スレッドのリリース時刻になった場合と
+ * タイマスレッドを起床させた場合のみレディー状態のスレッドが変化する
+ */
+static int tick_intr(void) {
+  int woken;
+
+  timer_expire();
+  kinfo.ticks++;
+  kinfo.tick_usec += TIMER_TICK_USEC;
+  kinfo.tick_cycle += TIMER_TICK_COUNT;
+
+  woken = 0;
+#if KZ_CONFIG_USE_PERIODIC
+  woken |= period_release();
+#endif
+#if KZ_CONFIG_USE_SWTIMER
+  woken |= kztimer_intr();
+#endif
+#if KZ_CONFIG_USE_BUDGET
+  woken |= budget_replenish();
+#endif
+  return woken;
+}
+
+/*
+ * 直前のティックの時刻とタイマのカウンタ値を取得する
+ * スレッドからも割込みハンドラからも呼べるように、割込み禁止にはせずに
+ * ティックの時刻を読み直して、途中でティックが進んでいないことを確認する
+ * また割込み禁止中でティックの割込みが未処理の場合には、1ティック分を補正する
+ */
+static unsigned int gettick(uint32 *usecp, uint32 *cyclep) {
+  uint32 usec, cycle;
+  unsigned int count;
+  int expired;
+
+  do {
+    usec = kz_kinfo->tick_usec;
+    cycle = kz_kinfo->tick_cycle;
+    count = timer_get_count();
+    expired = timer_is_expired();
+    if (expired) {
+      // カウンタがクリアされた後の値を読み直す
+      count = timer_get_count();
+    }
+  } while (usec != kz_kinfo->tick_usec);
+
+  if (expired) {
+    usec += TIMER_TICK_USEC;
+    cycle += TIMER_TICK_COUNT;
+  }
+
+  *usecp = usec;
+  *cyclep = cycle;
+  return count;
+}
+
+/*
+ * スレッドのディスパッチ
+ * (dispatch()関数の本体は startup.s にあり、アセンブラで記述されている)
+ */
+static void thread_dispatch(void) {
+#if KZ_CONFIG_USE_PERIODIC
+#if KZ_CONFIG_USE_STATISTICS
+  uint32 jitter;
+#endif
+
+  if (current->flags & KZ_THREAD_FLAG_RELEASED) {
+    /* 周期起床したスレッドの、リリースから実行開始までの遅れを記録する */
+    current->flags &= ~KZ_THREAD_FLAG_RELEASED;
+#if KZ_CONFIG_USE_STATISTICS
+    jitter = kz_gettime() - current->period.release_usec;
+    current->period.jitter = jitter;
+    if (jitter > current->period.jitter_max) {
+      current->period.jitter_max = jitter;
+    }
+#endif
+  }
+#endif
+
+#if KZ_CONFIG_USE_BUDGET
+  if (current->budget.budget) {
+    // 実行時間の計測開始
+    current->budget.start = kz_gettime();
+  }
+#endif
+
+  kinfo.current = (kz_thread_id_t)current;
+  kinfo.dispatches++;
+  dispatch(&current->context);
+  /* ここには返ってこない */
+}
+
+/* 割込み処理の入り口関数 */
+static void thread_intr(softvec_type_t type, unsigned long sp) {
+  /*
+   * 割込まれたスレッドを保存しておく
+   * (ハンドラ内のサービスコールで current は NULL にされる)
+   */
+  kz_thread *thp = current;
+  int exhausted = 0;
+
+  kinfo.intrs++;
+
+#if KZ_CONFIG_USE_BUDGET
+  /* 割込まれたスレッドの実行時間を加算する */
+  exhausted = budget_charge(thp);
+#endif
+
+  if (fasthandlers[type]) {
+    /*
+     * 高速割込みハンドラの場合は、レディー状態のスレッドに変化がなければ
+     * コンテキストの保存やスケジューリング、ディスパッチを行わずに
+     * 割込まれたスレッドにそのまま戻る
+     */
+    if (!fasthandlers[type]() && !exhausted) {
+      current = thp;
+      return;
+    }
+    thp->context.sp = sp;
+  } else {
+    /* カレントスレッドのコンテキストを保存する */
+    current->context.sp = sp;
+
+    /*
+    * 割込みごとの処理を実行する
+    * SOFTVEC_TYPE_SYSCALL, SOFTVEC_TYPE_SOFTERR の場合は
+    * syscall_intr(), softerr_intr() がハンドラに登録されているので、
+    * それらが実行される
+    * それ以外の場合は、kz_setintr() によってユーザ登録されたハンドラが
+    * 実行される
+    */
+    if (handlers[type]) {
+      handlers[type]();
+    }
+  }
+
+  /*
+   * 実行時間を使い切った場合は優先度を下げる
+   * (システムコールの処理でレディーキューを操作し終えてから行う)
+   */
+#if KZ_CONFIG_USE_BUDGET
+  if (exhausted) {
+    budget_demote(thp);
+    handoff = NULL; // 優先度が変わったので、スケジューリングし直す
+  }
+#endif
+
+  if (handoff) {
+    /* kz_call(), kz_reply() で切り替え先が決まっている場合は検索を省略する */
+    current = handoff;
+    handoff = NULL;
+  } else {
+    schedule();
+  }
+
+  /* スレッドのディスパッチ */
+  thread_dispatch();
+  /* ここには返ってこない */
+}
+
+/* メッセージボックスにスロットを割り当てる */
+static void msgbox_init(void) {
+  kz_msgslot *sp = msgslots;
+#if KZ_CONFIG_USE_STATISTICS
+  kz_msgbox_stat_t *statp = msgbox_stats; // 添字の計算で乗算にならないようにポインタで進める
+#endif
+  int i;
+
+#if KZ_CONFIG_USE_STATISTICS
+  memset(msgbox_stats, 0, sizeof(msgbox_stats));
+  for (i = 0; i < MSGBOX_NUM; i++) {
+    msgboxes[i].stat = statp++;
+  }
+#endif
+
+  for (i = 0; i < MSGBOX_ID_NUM; i++) {
+    msgboxes[i].slots = sp;
+    msgboxes[i].slotnum = msgbox_slotnum[i];
+    msgboxes[i].limit = msgbox_limit[i];
+    sp += msgbox_slotnum[i];
+    msgbox_state[i].used = 1; // 静的なものは常に使用中(世代番号は0)
+  }
+
+#if KZ_CONFIG_USE_MSGBOX_DYNAMIC
+  /* 動的なメッセージボックスは未使用にしておく */
+  for (; i < MSGBOX_NUM; i++) {
+    msgboxes[i].slots = sp;
+    msgboxes[i].slotnum = KZ_CONFIG_MSGBOX_SLOTS_DYNAMIC;
+    sp += KZ_CONFIG_MSGBOX_SLOTS_DYNAMIC;
+    msgbox_state[i].gen = 1;
+  }
+#endif
+}
+
+void kz_start(kz_func_t func, char *name, int priority, int stacksize, int argc, char *argv[]) {
+  memset(&kinfo, 0, sizeof(kinfo));
+
+  /* 動的メモリの初期化 */
+  kzmem_init(&kinfo.mem);
+#if KZ_CONFIG_USE_BOOTPROF
+  bootprof_mark("kzmem_init");
+#endif
+
+  /*
+  * 以降で呼び出すスレッド関連のライブラリ関数の内部で current を
   * 見ている場合があるので、current を NULL に初期化しておく
   */
   current = NULL;
+  handoff = NULL;
 
   memset(readyque, 0, sizeof(readyque)); // レディーキューが配列になったので、memset() でのゼロクリアに変更
   memset(threads, 0, sizeof(threads));
+  memset(freestacks, 0, sizeof(freestacks));
   memset(handlers, 0, sizeof(handlers));
+  memset(fasthandlers, 0, sizeof(fasthandlers));
   memset(msgboxes, 0, sizeof(msgboxes));
+  memset(msgbox_state, 0, sizeof(msgbox_state));
+  msgbox_init();
+#if KZ_CONFIG_USE_RING
+  ring_init();
+#endif
+#if KZ_CONFIG_USE_WORKPOOL
+  memset(&workpool, 0, sizeof(workpool));
+#endif
+#if KZ_CONFIG_USE_PERIODIC
+  periodque = NULL;
+#endif
+#if KZ_CONFIG_USE_BUDGET
+  budget_num = 0;
+#endif
+#if KZ_CONFIG_USE_PIPE
+  memset(pipes, 0, sizeof(pipes));
+#endif
+#if KZ_CONFIG_USE_TOPIC
+  memset(topics, 0, sizeof(topics));
+#endif
+#if KZ_CONFIG_USE_SWTIMER
+  kztimer_init();
+#endif
 
   /* 割込みハンドラの登録 */
-  thread_setintr(SOFTVEC_TYPE_SYSCALL, syscall_intr); // システムコール
-  thread_setintr(SOFTVEC_TYPE_SOFTERR, softerr_intr); // ダウン要因発生
+  thread_setintr(SOFTVEC_TYPE_SYSCALL, syscall_intr, NULL); // システムコール
+  thread_setintr(SOFTVEC_TYPE_SOFTERR, softerr_intr, NULL); // ダウン要因発生
+  thread_setintr(SOFTVEC_TYPE_TIMINTR, NULL, tick_intr); // システムティック
+
+  /* システムティックの開始(割込みは最初のスレッドで有効化される) */
+  timer_start();
 
   /* システムコール発行不可なので直接呼び出してスレッド作成する */
   current = (kz_thread *)thread_run(func, name, priority, stacksize, argc, argv);
 
   /* 最初のスレッドを起動 */
+#if KZ_CONFIG_USE_BOOTPROF
+  bootprof_mark("dispatch");
+#endif
+  kinfo.current = (kz_thread_id_t)current;
+  kinfo.dispatches++;
   dispatch(&current->context);
 
   /* ここには返ってこない */
@@ -563,6 +2933,85 @@ void kz_syscall(kz_syscall_type_t type, kz_syscall_param_t *param) {
   asm volatile ("trapa #0");
 }
 
+/* 現在時刻の取得(マイクロ秒) */
+uint32 kz_gettime(void) {
+  uint32 usec, cycle;
+  unsigned int count;
+
+  count = gettick(&usec, &cycle);
+  // 16ビットの除算で済むように、ティック内のカウント値のみを変換する
+  return usec + count / TIMER_CLOCK_PER_USEC;
+}
+
+/* 現在時刻の取得(タイマのカウント数) */
+uint32 kz_getcycles(void) {
+  uint32 usec, cycle;
+  unsigned int count;
+
+  count = gettick(&usec, &cycle);
+  return cycle + count;
+}
+
+/* 起動からのティック数の取得 */
+uint32 kz_getticks(void) {
+  return kz_kinfo->ticks;
+}
+
+#if KZ_CONFIG_USE_MODULE
+/*
+ * スレッドが動作中かどうかの確認(システムコールを使わずにTCBを参照する)
+ * 終了したスレッドのTCBはゼロクリアされるので、kz_exit() やソフトウエア
+ * エラーで終了した場合も検出できる.TCBが再利用されている場合に備えて、
+ * メイン関数も比較する
+ */
+int kz_thread_alive(kz_thread_id_t id, kz_func_t func) {
+  kz_thread *thp = thread_get(id);
+
+  return (thp != NULL) && (thp->init.func == func);
+}
+#endif
+
+#if KZ_CONFIG_USE_TOPIC
+/* 発行するメッセージの領域の獲得(参照カウントの分だけ余分に獲得する) */
+void *kz_topic_alloc(int size) {
+  kz_topicbuf *bp;
+
+  bp = kz_kmalloc(size + sizeof(*bp));
+  if (bp == NULL) {
+    return NULL;
+  }
+  bp->refs = 0;
+  return bp + 1;
+}
+#endif
+
+#if KZ_CONFIG_USE_RING
+/*
+ * リングバッファからの読み出し(消費者のスレッドから呼ぶ)
+ * in を更新するのは生産者だけなので、データがあればシステムコールを使わずに
+ * 読み出せる。データがないときだけ kz_ring_wait() で待つ
+ */
+int kz_ring_read(kz_ring_id_t id, char *p, int size) {
+  kz_ring *rp;
+
+  if ((id < 0) || (id >= RING_ID_NUM)) {
+    return -1;
+  }
+  rp = &rings[id];
+
+  if (!kzring_count(&rp->ring)) {
+    if (kz_ring_wait(id, 1) < 0) {
+      return -1;
+    }
+  }
+
+  if (ring_record[id]) {
+    return kzring_getrec(&rp->ring, p, size);
+  }
+  return kzring_read(&rp->ring, p, size);
+}
+#endif
+
 /* サービスコール呼び出し用ライブラリ関数 */
 void kz_srvcall(kz_syscall_type_t type, kz_syscall_param_t *param) {
   srvcall_proc(type, param);
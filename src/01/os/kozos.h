@@ -4,6 +4,9 @@
 #include "defines.h"
 #include "interrupt.h"
 #include "syscall.h"
+#include "timer.h"
+
+#define KZ_CYCLES_PER_USEC TIMER_CLOCK_PER_USEC
 
 /* システムコール */
 // スレッドの起動のシステムコール
@@ -18,15 +21,127 @@ kz_thread_id_t kz_getid(void);
 int kz_chpri(int priority);
 void *kz_kmalloc(int size);
 int kz_kmfree(void *p);
-int kz_send(kz_msgbox_id_t id, int size, char *p);
-kz_thread_id_t kz_recv(kz_msgbox_id_t id, int *sizep, char **pp);
+int kz_send(kz_msgbox_id_t id, int size, char *p); // メモリ不足で格納できなければ -1 を返す(p の所有権は移らない)
+int kz_trysend(kz_msgbox_id_t id, int size, char *p); // メッセージボックスが一杯ならブロックせずに -1 を返す
+kz_thread_id_t kz_recv(kz_msgbox_id_t id, int *sizep, char **pp); // 不正なIDならば0を返す
+#if KZ_CONFIG_USE_INBOX
+/*
+ * スレッドごとの受信箱(インボックス)への送信と、自スレッドの受信箱からの受信
+ * メッセージボックスを用意しなくても、スレッドIDを指定して送信できる
+ */
+int kz_send_thread(kz_thread_id_t id, int size, char *p); // 不正なIDならば -1 を返す
+kz_thread_id_t kz_recv_self(int *sizep, char **pp); // 送信元のスレッドIDを返す
+#endif
+#if KZ_CONFIG_USE_MSGPRI
+/*
+ * 優先度を指定してメッセージを送信する(優先度の高いものから受信される)
+ * MSG_PRIORITY_NORMAL より高い優先度のメッセージは、上限に関わらず格納されてブロックしない
+ */
+int kz_sendpri(kz_msgbox_id_t id, int size, char *p, int priority);
+#endif
+#if KZ_CONFIG_USE_RING
+/*
+ * リングバッファ(単一生産者・単一消費者)
+ * 書き込みはメモリを獲得しない。読み出しはデータがあればシステムコールを使わない
+ * 消費者のスレッドは、データ数が want 以上になったときだけ起床する
+ */
+int kz_ring_wait(kz_ring_id_t id, int want); // 読み出せるバイト数を返す
+int kz_ring_write(kz_ring_id_t id, int size, char *p); // 書き込めなければ -1 を返す
+int kz_ring_read(kz_ring_id_t id, char *p, int size); // データがなければ待つ
+#endif
+#if KZ_CONFIG_USE_MSGBOX_DYNAMIC
+/* メッセージボックスの作成(limit はメッセージ数の上限、0なら制限なし)。limit が負か、作成できなければ MSGBOX_ID_NONE を返す */
+kz_msgbox_id_t kz_msgbox_create(int limit);
+int kz_msgbox_destroy(kz_msgbox_id_t id); // メッセージや待ちスレッドが残っている場合は -1 を返す
+#endif
+#if KZ_CONFIG_USE_SENDV
+/*
+ * 複数のセグメントをまとめて1つのメッセージとして送信する(セグメントの
+ * 内容はコピーしないので、受信側が kz_kmfree() するまで書き換えないこと)
+ */
+int kz_sendv(kz_msgbox_id_t id, kz_iovec_t *iov, int iovcnt);
+/*
+ * セグメント単位でメッセージを受信する(iov は KZ_CONFIG_IOV_MAX 個の配列)
+ * kz_send() のメッセージは1つのセグメントとして受信する。使用後は *pp を kz_kmfree() する
+ */
+kz_thread_id_t kz_recvv(kz_msgbox_id_t id, kz_iovec_t *iov, int *iovcntp, char **pp);
+#endif
+#if KZ_CONFIG_USE_CALL
+/* 要求を送信して kz_reply() による応答を待つ(戻り値は応答のサイズ) */
+int kz_call(kz_msgbox_id_t id, int size, char *p, int *rsizep, char **rpp);
+int kz_reply(kz_thread_id_t id, int size, char *p); // kz_recv() で得た送信元に応答する
+#endif
 int kz_setintr(softvec_type_t type, kz_handler_t handler);
+int kz_setintr_fast(softvec_type_t type, kz_fasthandler_t handler);
+#if KZ_CONFIG_USE_WORKPOOL
+int kz_job_post(kz_job_func_t func, void *arg, kz_msgbox_id_t notify);
+#if KZ_CONFIG_USE_STATISTICS
+int kz_job_stat(kz_jobstat_t *stat);
+#endif
+#endif
+#if KZ_CONFIG_USE_PERIODIC
+int kz_setperiod(int msec);
+int kz_wait_next_period(void);
+#endif
+#if KZ_CONFIG_USE_STATISTICS
+int kz_thread_stat(int index, kz_thread_stat_t *stat);
+/* index 番目のメッセージボックスの統計情報(範囲外なら -1、未使用なら0を返す) */
+int kz_msgbox_stat(int index, kz_msgbox_stat_t *stat);
+#endif
+#if KZ_CONFIG_USE_SWTIMER
+kz_timer_id_t kz_timer_create(kz_timer_func_t func, void *arg);
+int kz_timer_start(kz_timer_id_t id, int msec, int interval);
+int kz_timer_stop(kz_timer_id_t id);
+#endif
+#if KZ_CONFIG_USE_BUDGET
+int kz_setbudget(uint32 budget_usec, int msec);
+#endif
+#if KZ_CONFIG_USE_PIPE
+/*
+ * パイプ: スレッド間でバイト列を受け渡す(固定サイズのリングバッファを使う)
+ * 読み出しは、block が0以外ならデータが来るまで待ち、あるだけ(最大 size)読み出す
+ * 書き込みは、block が0以外ならすべて書き込むまで待ち、0なら入る分だけ書き込む
+ * いずれも処理したバイト数を返す(不正なIDなら -1)
+ */
+kz_pipe_id_t kz_pipe_create(void); // 作成できなければ -1 を返す
+int kz_pipe_destroy(kz_pipe_id_t id); // 待っているスレッドがいれば -1 を返す
+int kz_pipe_read(kz_pipe_id_t id, char *p, int size, int block);
+int kz_pipe_write(kz_pipe_id_t id, char *p, int size, int block);
+#endif
+#if KZ_CONFIG_USE_TOPIC
+/*
+ * トピック: 発行したメッセージを、購読しているメッセージボックスのすべてに
+ * 同じ領域のまま配送する。領域は kz_topic_alloc() で獲得し、受信した側は
+ * kz_kmfree() の代わりに kz_topic_release() を呼ぶ(全員が解放したら解放される)
+ */
+kz_topic_id_t kz_topic_create(void); // 作成できなければ -1 を返す
+int kz_topic_subscribe(kz_topic_id_t id, kz_msgbox_id_t mbox);
+int kz_topic_unsubscribe(kz_topic_id_t id, kz_msgbox_id_t mbox);
+void *kz_topic_alloc(int size);
+int kz_topic_publish(kz_topic_id_t id, int size, char *p); // 配送した数を返す(一杯のメッセージボックスには配送しない。p が NULL なら -1)
+int kz_topic_release(char *p); // p が NULL なら -1 を返す
+#endif
+#if KZ_CONFIG_USE_BATCH
+int kz_batch(kz_batch_t *ops, int num); // ブロックするか送信に失敗したシステムコールで止まる
+kz_thread_id_t kz_sendrecv(kz_msgbox_id_t sid, int size, char *p, kz_msgbox_id_t rid, int *sizep, char **pp);
+#endif
+#if KZ_CONFIG_USE_WORKPOOL
+// ワーカスレッドが利用するシステムコール
+int kz_job_get(kz_job_t *job);
+int kz_job_done(kz_job_t *job, int result);
+#endif
 
 /* サービスコール */
 int kx_wakeup(kz_thread_id_t id);
 void *kx_kmalloc(int size);
 int kx_kmfree(void *p);
-int kx_send(kz_msgbox_id_t id, int size, char *p);
+int kx_send(kz_msgbox_id_t id, int size, char *p); // メッセージボックスが一杯かメモリ不足なら -1 を返す
+#if KZ_CONFIG_USE_RING
+int kx_ring_write(kz_ring_id_t id, int size, char *p); // 割込み処理からの書き込み
+#endif
+
+/* カーネル情報ブロック(システムコールを使わずに参照できる) */
+extern const volatile kz_kinfo_t * const kz_kinfo;
 
 /* ライブラリ関数 */
 // 初期スレッドを起動し、OSの動作を開始する
@@ -36,9 +151,28 @@ void kz_sysdown(void);
 // システムコールを実行する
 void kz_syscall(kz_syscall_type_t type, kz_syscall_param_t *param);
 void kz_srvcall(kz_syscall_type_t type, kz_syscall_param_t *param);
+// 現在時刻を取得する(システムコールを使わないので、割込みハンドラからも呼べる)
+uint32 kz_gettime(void); // マイクロ秒単位
+uint32 kz_getcycles(void); // タイマのカウント単位(KZ_CYCLES_PER_USEC カウントで1マイクロ秒)
+uint32 kz_getticks(void); // 起動からのティック数
+#if KZ_CONFIG_USE_MODULE
+// スレッドが動作中かを確認する(func はスレッドのメイン関数)
+int kz_thread_alive(kz_thread_id_t id, kz_func_t func);
+#endif
+#if KZ_CONFIG_USE_WORKPOOL
+// ワーカスレッドプールを起動する
+int kz_workpool_start(int num, int priority, int stacksize);
+#endif
 
 /* システムタスク */
 int consdrv_main(int argc, char *argv[]);
+#if KZ_CONFIG_USE_SWTIMER
+int timerd_main(int argc, char *argv[]);
+#endif
+
+#if KZ_CONFIG_USE_WORKPOOL
+int workpool_main(int argc, char *argv[]);
+#endif
 
 /* ユーザタスク */
 int command_main(int argc, char *argv[]);
@@ -0,0 +1,155 @@
+#ifndef _KOZOS_CONFIG_H_INCLUDED_
+#define _KOZOS_CONFIG_H_INCLUDED_
+
+/*
+ * カーネルの構成
+ * 機能を0にすると、その機能のシステムコールとコード、データが
+ * コンパイル時に削除される。各設定はコンパイルオプションで
+ * 上書きできる(例: make KZCONFIG="-DKZ_CONFIG_USE_SWTIMER=1")
+ * カーネルの text, data, bss と動的メモリ(2KB)は ld.scr の ram 領域
+ * (11744バイト)に収まらなければならない(リンク時に確認される)。
+ * 標準の構成は、コンソールが使う kz_sendv() と優先度付きのメッセージ
+ * だけを組み込む。機能を追加してリンクや make のサイズの確認が通らない
+ * 場合は、他の機能を0にすること(すべて0にしたものが最小の構成)
+ */
+
+/* スレッドと優先度 */
+#ifndef KZ_CONFIG_THREAD_NUM
+#define KZ_CONFIG_THREAD_NUM 8 // TCBの個数
+#endif
+#ifndef KZ_CONFIG_PRIORITY_NUM
+#define KZ_CONFIG_PRIORITY_NUM 16 // 優先度の個数(最低の優先度はアイドルスレッドが使う)
+#endif
+
+/*
+ * メモリプールの構成({ ブロックのサイズ, ブロックの個数 } の並び)
+ * サイズの小さい順に並べ、サイズ×個数は64バイトの倍数、合計は2KBまでとする
+ */
+#ifndef KZ_CONFIG_MEMORY_POOLS
+#define KZ_CONFIG_MEMORY_POOLS { 16, 8 }, { 32, 8 }, { 64, 4 }
+#endif
+
+/*
+ * メッセージボックスごとのメッセージスロットの数
+ * スロットに空きがあれば、送信と受信でメモリの獲得と解放を行わない
+ * (0ならスロットを持たず、メッセージごとにメモリプールから獲得する)
+ */
+#ifndef KZ_CONFIG_MSGBOX_SLOTS_CONSOUTPUT
+#define KZ_CONFIG_MSGBOX_SLOTS_CONSOUTPUT 8
+#endif
+#ifndef KZ_CONFIG_MSGBOX_SLOTS_CONSINPUT
+#define KZ_CONFIG_MSGBOX_SLOTS_CONSINPUT 2 // リングバッファを使わない構成のみ
+#endif
+
+/*
+ * メッセージボックスごとに格納できるメッセージの上限
+ * (上限に達すると kz_send() はブロックし、kz_trysend() と kx_send() は -1 を返す。0なら制限なし)
+ */
+#ifndef KZ_CONFIG_MSGBOX_LIMIT_CONSOUTPUT
+#define KZ_CONFIG_MSGBOX_LIMIT_CONSOUTPUT 16
+#endif
+#ifndef KZ_CONFIG_MSGBOX_LIMIT_CONSINPUT
+#define KZ_CONFIG_MSGBOX_LIMIT_CONSINPUT 4 // リングバッファを使わない構成のみ
+#endif
+
+/* リングバッファごとのサイズ(2の累乗にすること) */
+#ifndef KZ_CONFIG_RING_SIZE_CONSINPUT
+#define KZ_CONFIG_RING_SIZE_CONSINPUT 64
+#endif
+
+/* パイプの数と、それぞれのバッファのサイズ(2の累乗にすること) */
+#ifndef KZ_CONFIG_PIPE_NUM
+#define KZ_CONFIG_PIPE_NUM 2
+#endif
+#ifndef KZ_CONFIG_PIPE_SIZE
+#define KZ_CONFIG_PIPE_SIZE 64
+#endif
+
+/* kz_msgbox_create() で作成できるメッセージボックスの数と、それぞれのスロット数 */
+#ifndef KZ_CONFIG_MSGBOX_DYNAMIC_NUM
+#define KZ_CONFIG_MSGBOX_DYNAMIC_NUM 4
+#endif
+#ifndef KZ_CONFIG_MSGBOX_SLOTS_DYNAMIC
+#define KZ_CONFIG_MSGBOX_SLOTS_DYNAMIC 2
+#endif
+
+/* トピックの数と、1つのトピックを購読できるメッセージボックスの数 */
+#ifndef KZ_CONFIG_TOPIC_NUM
+#define KZ_CONFIG_TOPIC_NUM 4
+#endif
+#ifndef KZ_CONFIG_TOPIC_SUBSCRIBERS
+#define KZ_CONFIG_TOPIC_SUBSCRIBERS 6
+#endif
+
+/* kz_sendv() で1回に送信できるセグメントの最大数 */
+#ifndef KZ_CONFIG_IOV_MAX
+#define KZ_CONFIG_IOV_MAX 4
+#endif
+
+/* 送信待ちと受信待ちのスレッドの順序(0: 到着順、1: 優先度順) */
+#ifndef KZ_CONFIG_MSGBOX_WAIT_PRIORITY
+#define KZ_CONFIG_MSGBOX_WAIT_PRIORITY 1
+#endif
+
+/* 機能の選択 */
+#ifndef KZ_CONFIG_USE_MSGPRI
+#define KZ_CONFIG_USE_MSGPRI 1 // 優先度付きのメッセージ(kz_sendpri())
+#endif
+#ifndef KZ_CONFIG_USE_CALL
+#define KZ_CONFIG_USE_CALL 0 // 同期メッセージ(kz_call(), kz_reply())
+#endif
+#ifndef KZ_CONFIG_USE_INBOX
+#define KZ_CONFIG_USE_INBOX 0 // スレッド宛てのメッセージ(kz_send_thread(), kz_recv_self())
+#endif
+#ifndef KZ_CONFIG_USE_SENDV
+#define KZ_CONFIG_USE_SENDV 1 // セグメントの配列の送受信(kz_sendv(), kz_recvv())
+#endif
+#ifndef KZ_CONFIG_USE_RING
+#define KZ_CONFIG_USE_RING 0 // リングバッファ(kz_ring_read() など。使わない場合コンソール入力はメッセージで渡す)
+#endif
+#ifndef KZ_CONFIG_USE_MSGBOX_DYNAMIC
+#define KZ_CONFIG_USE_MSGBOX_DYNAMIC 0 // 動的なメッセージボックス(kz_msgbox_create(), kz_msgbox_destroy())
+#endif
+#ifndef KZ_CONFIG_USE_BATCH
+#define KZ_CONFIG_USE_BATCH 0 // システムコールの一括発行(kz_batch(), kz_sendrecv())
+#endif
+#ifndef KZ_CONFIG_USE_WORKPOOL
+#define KZ_CONFIG_USE_WORKPOOL 0 // ワーカスレッドプール(kz_job_post() など)
+#endif
+#ifndef KZ_CONFIG_USE_PERIODIC
+#define KZ_CONFIG_USE_PERIODIC 0 // 周期スレッド(kz_setperiod(), kz_wait_next_period())
+#endif
+#ifndef KZ_CONFIG_USE_SWTIMER
+#define KZ_CONFIG_USE_SWTIMER 0 // ソフトウェアタイマ(kz_timer_create() など)
+#endif
+#ifndef KZ_CONFIG_USE_BUDGET
+#define KZ_CONFIG_USE_BUDGET 0 // 実行時間の制限(kz_setbudget())
+#endif
+#ifndef KZ_CONFIG_USE_TOPIC
+#define KZ_CONFIG_USE_TOPIC 0 // トピックによるメッセージの一斉配送(kz_topic_publish() など)
+#endif
+#ifndef KZ_CONFIG_USE_PIPE
+#define KZ_CONFIG_USE_PIPE 0 // スレッド間のバイトストリーム(kz_pipe_read(), kz_pipe_write() など)
+#endif
+#ifndef KZ_CONFIG_USE_MODULE
+#define KZ_CONFIG_USE_MODULE 0 // アプリケーションモジュールのロード(コンソールの load コマンド)
+#endif
+
+/* 計測機能 */
+#ifndef KZ_CONFIG_USE_STATISTICS
+#define KZ_CONFIG_USE_STATISTICS 0 // 統計情報(kz_thread_stat(), kz_job_stat(), リリースジッタの計測)
+#endif
+#ifndef KZ_CONFIG_USE_BENCH
+#define KZ_CONFIG_USE_BENCH 0 // ベンチマーク(コンソールの bench コマンドと計測用のメッセージボックス)
+#endif
+#ifndef KZ_CONFIG_MSGBOX_SLOTS_BENCH
+#define KZ_CONFIG_MSGBOX_SLOTS_BENCH 8 // ベンチマーク用のメッセージボックスのスロット数
+#endif
+#ifndef KZ_CONFIG_MSGBOX_LIMIT_BENCH
+#define KZ_CONFIG_MSGBOX_LIMIT_BENCH 8 // ベンチマーク用のメッセージボックスのメッセージ数の上限
+#endif
+#ifndef KZ_CONFIG_USE_BOOTPROF
+#define KZ_CONFIG_USE_BOOTPROF 0 // 起動時間の計測(ブートローダの記録に続けてチェックポイントを記録する)
+#endif
+
+#endif
@@ -2,13 +2,20 @@
 #include "kozos.h"
 #include "interrupt.h"
 #include "lib.h"
+#include "bootprof.h"
 
 /* システムタスクとユーザタスクの起動 */
 static int start_threads(int argc, char *argv[]) {
+#if KZ_CONFIG_USE_SWTIMER
+  kz_run(timerd_main, "timerd", 0, 0x100, 0, NULL);
+#endif
   kz_run(consdrv_main, "consdrv", 1, 0x100, 0, NULL);
   kz_run(command_main, "command", 8, 0x100, 0, NULL);
+#if KZ_CONFIG_USE_WORKPOOL
+  kz_workpool_start(2, 9, 0x100); // コマンド処理より低い優先度でワーカスレッドを起動
+#endif
 
-  kz_chpri(15); // 優先順位を下げて、アイドルスレッドに移行する
+  kz_chpri(KZ_CONFIG_PRIORITY_NUM - 1); // 優先順位を最低に下げて、アイドルスレッドに移行する
   INTR_ENABLE; // 割込み有効化
   while (1) {
     asm volatile ("sleep");
@@ -19,6 +26,9 @@ static int start_threads(int argc, char *argv[]) {
 
 int main(void) {
   INTR_DISABLE;
+#if KZ_CONFIG_USE_BOOTPROF
+  bootprof_mark("kozos main");
+#endif
   puts("kozos boot succeed!\n");
   // OSの動作開始
   kz_start(start_threads, "idle", 0, 0x100, 0, NULL);
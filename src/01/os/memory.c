@@ -5,11 +5,11 @@
 
 /*
 * メモリブロック構造体
-* (獲得された各領域は、先頭に以下の構造体を持っている)
+* 領域にはヘッダを持たせず、解放済みの領域の先頭にだけ次の領域への
+* ポインタを置く(獲得された領域は、ブロック全体を利用できる)
 */
 typedef struct _kzmem_block {
   struct _kzmem_block *next;
-  int size;
 } kzmem_block;
 
 /* メモリプール */
@@ -21,19 +21,54 @@ typedef struct _kzmem_pool {
 
 /* メモリプールの定義(個々のサイズと個数) */
 static kzmem_pool pool[] = {
-  // 16 バイト、32バイト、64バイトの3種類のメモリプールを定義する
-  { 16, 8, NULL}, { 32, 8, NULL }, { 64, 4, NULL },
+  // 構成は kozos_config.h の KZ_CONFIG_MEMORY_POOLS で定義する
+  KZ_CONFIG_MEMORY_POOLS
 };
 
 #define MEMORY_AREA_NUM (sizeof(pool)) / sizeof(*pool)
 
+/*
+ * 各プールは連続した領域を占めるので、解放する領域のアドレスからプールが決まる
+ * 空き領域を KZMEM_PAGE_SIZE 単位に区切り、区画ごとのプールを表で引く
+ * (プールの領域のサイズ(サイズ×個数)は KZMEM_PAGE_SIZE の倍数にすること)
+ */
+#define KZMEM_PAGE_SHIFT 6
+#define KZMEM_PAGE_SIZE (1 << KZMEM_PAGE_SHIFT)
+#define KZMEM_PAGE_NUM 32 // 管理できる空き領域は 2KB まで
+
+/*
+ * 獲得するサイズからプールを引く表
+ * サイズを KZMEM_CLASS_SIZE 単位に切り上げた値で引く
+ */
+#define KZMEM_CLASS_SHIFT 4
+#define KZMEM_CLASS_SIZE (1 << KZMEM_CLASS_SHIFT)
+#define KZMEM_CLASS_NUM 17 // 256バイトまで
+
+#define KZMEM_NONE 0xff // 該当するプールがない
+
+static char *area_start; // プールの領域の先頭
+static char *area_end; // プールの領域の末尾
+static uint8 page_pool[KZMEM_PAGE_NUM]; // 区画ごとのプールの番号
+static uint8 class_pool[KZMEM_CLASS_NUM]; // サイズごとのプールの番号
+
+static kz_memstat_t *memstat; // 統計情報(カーネル情報ブロック内)
+
 /* メモリプールの初期化 */
-static int kzmem_init_pool(kzmem_pool *p) {
-  int i;
+static int kzmem_init_pool(int index, char **areap) {
+  kzmem_pool *p = &pool[index];
+  int i, page;
   kzmem_block *mp;
   kzmem_block **mpp;
-  extern char freearea; // リンカスクリプトで定義される空き領域
-  static char *area = &freearea;
+  char *area = *areap;
+
+  /* 区画の表にプールを登録する */
+  page = (area - area_start) >> KZMEM_PAGE_SHIFT;
+  for (i = 0; i < ((p->size * p->num) >> KZMEM_PAGE_SHIFT); i++) {
+    if (page >= KZMEM_PAGE_NUM) {
+      kz_sysdown(); // 空き領域が大きすぎる
+    }
+    page_pool[page++] = index;
+  }
 
   mp = (kzmem_block *)area;
 
@@ -41,74 +76,104 @@ static int kzmem_init_pool(kzmem_pool *p) {
   mpp = &p->free;
   for (i = 0; i < p->num; i++) {
     *mpp = mp;
-    memset(mp, 0, sizeof(*mp));
-    mp->size = p->size;
     mpp = &(mp->next);
     mp = (kzmem_block *)((char *)mp + p->size);
     area += p->size;
   }
+  *mpp = NULL;
 
+  *areap = area;
   return 0;
 }
 
 /* 動的メモリの初期化 */
-int kzmem_init(void) {
-  int i;
+int kzmem_init(kz_memstat_t *stat) {
+  int i, class;
+  extern char freearea; // リンカスクリプトで定義される空き領域
+  char *area = &freearea;
+
+  memstat = stat;
+  area_start = area;
+  memset(page_pool, KZMEM_NONE, sizeof(page_pool));
   for (i = 0; i < MEMORY_AREA_NUM; i++) {
-    kzmem_init_pool(&pool[i]); // 各メモリプールを初期化する
+    kzmem_init_pool(i, &area); // 各メモリプールを初期化する
+  }
+  area_end = area;
+
+  /* サイズごとに、収まる最小のプールを求めておく(プールはサイズの小さい順に並べること) */
+  for (class = 0; class < KZMEM_CLASS_NUM; class++) {
+    class_pool[class] = KZMEM_NONE;
+    for (i = 0; i < MEMORY_AREA_NUM; i++) {
+      if ((class << KZMEM_CLASS_SHIFT) <= pool[i].size) {
+        class_pool[class] = i;
+        break;
+      }
+    }
   }
+
   return 0;
 }
 
-/* 動的メモリの獲得 */
+/*
+ * 動的メモリの獲得
+ * 収まるプールが空なら、空きのあるより大きいプールから獲得する
+ * どのプールからも獲得できない場合は、失敗を数えて NULL を返す
+ */
 void *kzmem_alloc(int size) {
-  int i;
+  int class, i;
   kzmem_block *mp;
   kzmem_pool *p;
-  
-  for (i = 0; i < MEMORY_AREA_NUM; i++) {
-    p = &pool[i];
-    if (size <= p->size - sizeof(kzmem_block)) {
-      if (p->free == NULL) { // 要求されたサイズが収まるか？
-        // 解放済み領域がない場合はメモリ枯渇が起きている
-        kz_sysdown();
-        return NULL;
-      }
-      /* 解放済みリンクリストから領域を取得する */
-      mp = p->free;
-      p->free = p->free->next;
-      mp->next = NULL;
-
-      /*
-      * 実際に利用可能な領域は、メモリブロック構造体の直後の領域に
-      * なるので、直後のアドレスを返す
-      */
-      return mp + 1;
+
+  /* 要求されたサイズが収まるプールを表で求める */
+  class = (size + KZMEM_CLASS_SIZE - 1) >> KZMEM_CLASS_SHIFT;
+  if ((size < 0) || (class >= KZMEM_CLASS_NUM) || (class_pool[class] == KZMEM_NONE)) {
+    /* 指定されたサイズの領域を格納できるメモリプールがない */
+    memstat->fails++;
+    return NULL;
+  }
+
+  for (i = class_pool[class]; i < MEMORY_AREA_NUM; i++) {
+    if (pool[i].free) {
+      break;
     }
   }
-  /* 指定されたサイズの領域を格納できるメモリプールがない */
-  kz_sysdown();
-  return NULL;
+  if (i == MEMORY_AREA_NUM) {
+    /* 解放済み領域がない(メモリ枯渇) */
+    memstat->fails++;
+    return NULL;
+  }
+  if (i != class_pool[class]) {
+    memstat->spills++;
+  }
+  p = &pool[i];
+
+  /* 解放済みリンクリストから領域を取得する */
+  mp = p->free;
+  p->free = p->free->next;
+
+  memstat->allocs++;
+  if (++memstat->used > memstat->peak) {
+    memstat->peak = memstat->used;
+  }
+
+  return mp; // ヘッダはないので、ブロックの先頭をそのまま返す
 }
 
 /* メモリの開放 */
 void kzmem_free(void *mem) {
-  int i;
-  kzmem_block *mp;
+  kzmem_block *mp = mem;
   kzmem_pool *p;
 
-  /* 領域の直前にある(はずの)メモリブロック構造体を取得 */
-  mp = ((kzmem_block *)mem - 1);
-
-  for (i = 0; i < MEMORY_AREA_NUM; i++) {
-    p = &pool[i];
-    if (mp->size == p->size) {
-      /* 領域を解放済みリンクリストに戻す */
-      mp->next = p->free;
-      p->free = mp;
-      return;
-    }
+  if (((char *)mem < area_start) || ((char *)mem >= area_end)) {
+    kz_sysdown(); // 動的メモリの領域ではない
+    return;
   }
 
-  kz_sysdown();
+  /* アドレスから、領域の属するプールを表で求める */
+  p = &pool[page_pool[((char *)mem - area_start) >> KZMEM_PAGE_SHIFT]];
+
+  /* 領域を解放済みリンクリストに戻す */
+  mp->next = p->free;
+  p->free = mp;
+  memstat->used--;
 }
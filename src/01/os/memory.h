@@ -1,7 +1,7 @@
 #ifndef _KOZOS_MEMORY_H_INCLUDED_
 #define _KOZOS_MEMORY_H_INCLUDED_
 
-int kzmem_init(void); // 動的メモリの初期化
+int kzmem_init(kz_memstat_t *stat); // 動的メモリの初期化(統計情報の格納先を指定する)
 void *kzmem_alloc(int size); // 動的メモリの獲得
 void kzmem_free(void *mem); // メモリの開放
 
@@ -0,0 +1,71 @@
+#include "defines.h"
+#include "kozos.h"
+#include "interrupt.h"
+#include "serial.h"
+#include "xmodem.h"
+#include "lib.h"
+#include "module.h"
+
+#if KZ_CONFIG_USE_MODULE
+
+/*
+ * モジュール領域は1つなので、前回ロードしたモジュールのスレッドが
+ * 終了するまでは、次のモジュールをロードできない
+ * (kz_exit() やソフトウエアエラーで終了した場合はエントリ関数から
+ * 戻らないので、スレッドが動作中かどうかもTCBで確認する)
+ */
+static volatile kz_thread_id_t module_id;
+
+/* モジュールのスレッドのメイン関数(エントリ関数から戻ったら領域を開放する) */
+static int module_main(int argc, char *argv[]) {
+  kz_module_t *mp = (kz_module_t *)MODULE_AREA_ADDR;
+  int ret;
+
+  ret = mp->entry(argc, argv);
+  module_id = 0;
+  return ret;
+}
+
+/*
+ * コンソールからモジュールを XMODEM で受信して、スレッドとして起動する
+ * 受信中はコンソールドライバと競合しないように割込み禁止にするので、
+ * システムティックやタイマなどは受信が終わるまで止まる
+ */
+int module_load(void) {
+  kz_module_t *mp = (kz_module_t *)MODULE_AREA_ADDR;
+  kz_thread_id_t id;
+  long size;
+
+  if (module_id && kz_thread_alive(module_id, module_main)) {
+    return MODULE_ERR_BUSY;
+  }
+
+  INTR_DISABLE;
+  size = xmodem_recv(MODULE_AREA_ADDR, MODULE_AREA_SIZE);
+  INTR_ENABLE;
+
+  if (size < (long)sizeof(*mp)) {
+    return MODULE_ERR_RECV;
+  }
+
+  /* リンクしたカーネルとモジュール領域の確認 */
+  if ((mp->magic != KZ_MODULE_MAGIC) || (mp->kernel != (void *)kz_start)) {
+    return MODULE_ERR_INVALID;
+  }
+  if ((mp->bss_start < MODULE_AREA_ADDR) || (mp->bss_end < mp->bss_start) ||
+      (mp->bss_end > MODULE_AREA_ADDR + MODULE_AREA_SIZE)) {
+    return MODULE_ERR_INVALID;
+  }
+  memset(mp->bss_start, 0, mp->bss_end - mp->bss_start);
+  mp->name[THREAD_NAME_SIZE] = '\0';
+
+  id = kz_run(module_main, mp->name, mp->priority, mp->stacksize, 0, NULL);
+  if (id == (kz_thread_id_t)-1) {
+    return MODULE_ERR_RUN;
+  }
+  module_id = id;
+
+  return 0;
+}
+
+#endif
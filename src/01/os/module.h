@@ -0,0 +1,49 @@
+#ifndef _KOZOS_MODULE_H_INCLUDED_
+#define _KOZOS_MODULE_H_INCLUDED_
+
+#include "defines.h"
+
+/*
+ * アプリケーションモジュール
+ * モジュールはカーネルの実行形式(kozos.elf)のシンボルを参照してリンクし
+ * (ld の -R オプション)、モジュール領域に配置したバイナリとして作成する
+ * (作り方は module/Makefile を参照)。カーネルのシンボルのアドレスが
+ * 変わるので、カーネルを作り直したらモジュールもリンクし直すこと
+ */
+
+/* 以下はリンカスクリプトで定義してあるシンボル */
+extern char modulearea;
+#define MODULE_AREA_ADDR (&modulearea)
+#define MODULE_AREA_SIZE 0x600 // ld.scr の module 領域のサイズと一致させること
+
+#define KZ_MODULE_MAGIC 0x4b5a4d44 // "KZMD"
+
+/* モジュールヘッダ(モジュールの先頭に配置される) */
+typedef struct {
+  uint32 magic;
+  void *kernel; // リンクしたカーネルの kz_start() のアドレス(カーネルとの一致の確認用)
+  kz_func_t entry; // エントリ関数(スレッドのメイン関数として起動される)
+  char *bss_start; // BSS 領域(ロード時にゼロクリアする)
+  char *bss_end;
+  int priority; // スレッドの優先度
+  int stacksize; // スレッドのスタックサイズ
+  char name[THREAD_NAME_SIZE + 1]; // スレッド名
+} kz_module_t;
+
+/* モジュールヘッダの定義(モジュールのソースのどれか1つに記述する) */
+#define KZ_MODULE(name, entry, priority, stacksize) \
+  extern char module_bss_start, module_ebss; \
+  const kz_module_t kz_module_header __attribute__((section(".modhead"))) = { \
+    KZ_MODULE_MAGIC, (void *)kz_start, entry, \
+    &module_bss_start, &module_ebss, priority, stacksize, name \
+  }
+
+/* module_load() のエラー */
+#define MODULE_ERR_BUSY -1 // 前回ロードしたモジュールのスレッドが動作中
+#define MODULE_ERR_RECV -2 // 受信エラー
+#define MODULE_ERR_INVALID -3 // モジュールの形式が不正か、カーネルが一致しない
+#define MODULE_ERR_RUN -4 // スレッドを起動できない
+
+int module_load(void); /* コンソールからモジュールを受信してスレッドとして起動する */
+
+#endif
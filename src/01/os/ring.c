@@ -0,0 +1,88 @@
+#include "defines.h"
+#include "ring.h"
+
+/* カーネルのリングバッファとパイプで使う */
+#if KZ_CONFIG_USE_RING || KZ_CONFIG_USE_PIPE
+
+
+/* リングバッファの初期化 */
+void kzring_init(kzring *rp, char *buf, int size) {
+  rp->buf = buf;
+  rp->mask = size - 1;
+  rp->in = 0;
+  rp->out = 0;
+}
+
+int kzring_count(kzring *rp) {
+  return rp->in - rp->out;
+}
+
+int kzring_space(kzring *rp) {
+  return rp->mask + 1 - (rp->in - rp->out);
+}
+
+/* pos の位置から書き込む(バッファの末尾で先頭に折り返す) */
+static void copy_in(kzring *rp, unsigned int pos, char *p, int size) {
+  while (size--) {
+    rp->buf[pos++ & rp->mask] = *(p++);
+  }
+}
+
+/* pos の位置から読み出す */
+static void copy_out(kzring *rp, unsigned int pos, char *p, int size) {
+  while (size--) {
+    *(p++) = rp->buf[pos++ & rp->mask];
+  }
+}
+
+int kzring_write(kzring *rp, char *p, int size) {
+  int space = kzring_space(rp);
+
+  if (size > space) {
+    size = space;
+  }
+  copy_in(rp, rp->in, p, size);
+  rp->in += size; // 書き込んでから進める
+  return size;
+}
+
+int kzring_read(kzring *rp, char *p, int size) {
+  int count = kzring_count(rp);
+
+  if (size > count) {
+    size = count;
+  }
+  copy_out(rp, rp->out, p, size);
+  rp->out += size; // 読み出してから進める
+  return size;
+}
+
+int kzring_putrec(kzring *rp, char *p, int size) {
+  unsigned int in = rp->in;
+
+  if ((size > 0xff) || (size + 1 > kzring_space(rp))) {
+    return -1;
+  }
+  rp->buf[in & rp->mask] = size;
+  copy_in(rp, in + 1, p, size);
+  rp->in = in + 1 + size; // レコード全体を書き込んでから進める
+  return size;
+}
+
+int kzring_getrec(kzring *rp, char *p, int size) {
+  unsigned int out = rp->out;
+  int len;
+
+  if (!kzring_count(rp)) {
+    return -1;
+  }
+  len = (unsigned char)rp->buf[out & rp->mask];
+  if (size > len) {
+    size = len;
+  }
+  copy_out(rp, out + 1, p, size);
+  rp->out = out + 1 + len;
+  return size;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _KOZOS_RING_H_INCLUDED_
+#define _KOZOS_RING_H_INCLUDED_
+
+#include "defines.h"
+
+/*
+ * 単一生産者・単一消費者のリングバッファ
+ * in は生産者だけが、out は消費者だけが更新するので、一方が割込み処理でも
+ * 排他なしで読み書きできる(16ビットの書き込みは分割されない)
+ * in と out は剰余を取らずに進め、バッファの位置は mask で求める
+ */
+typedef struct _kzring {
+  char *buf; // バッファ(サイズは2の累乗)
+  unsigned int mask; // バッファのサイズ - 1
+  volatile unsigned int in; // 次に書き込む位置(生産者が更新する)
+  volatile unsigned int out; // 次に読み出す位置(消費者が更新する)
+} kzring;
+
+void kzring_init(kzring *rp, char *buf, int size); // 初期化(size は2の累乗)
+int kzring_count(kzring *rp); // 読み出せるバイト数
+int kzring_space(kzring *rp); // 書き込めるバイト数
+
+/* バイト列として読み書きする(書き込めた/読み出せた分だけ処理する) */
+int kzring_write(kzring *rp, char *p, int size);
+int kzring_read(kzring *rp, char *p, int size);
+
+/*
+ * レコード(先頭1バイトにサイズを置いたもの)として読み書きする
+ * 書き込みはレコード全体が入らなければ -1 を返す。読み出しは p に入らない
+ * 部分を捨てる。レコードは最後に in を進めるので、消費者からは途中が見えない
+ */
+int kzring_putrec(kzring *rp, char *p, int size);
+int kzring_getrec(kzring *rp, char *p, int size);
+
+#endif
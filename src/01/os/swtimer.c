@@ -0,0 +1,304 @@
+#include "defines.h"
+#include "kozos.h"
+#include "lib.h"
+#include "swtimer.h"
+
+#if KZ_CONFIG_USE_SWTIMER
+
+/*
+ * ソフトウェアタイマ(階層タイマホイール)
+ *
+ * タイマは満了時刻(ティック数)によって、以下のいずれかのスロットに繋がれる
+ *   レベル0: 満了まで 16 ティック未満(1スロット = 1ティック)
+ *   レベル1: 満了まで 256 ティック未満(1スロット = 16ティック)
+ *   レベル2: 満了まで 4096 ティック未満(1スロット = 256ティック)
+ * 上位レベルのスロットは、時刻がそのスロットの範囲に入ったときに下位の
+ * レベルに繋ぎ直す(カスケード)ので、タイマの数によらず登録と満了の処理は
+ * O(1) となる
+ *
+ * コールバック関数は割込みハンドラではなく、タイマスレッド(timerd)で
+ * 実行する。timerd は優先度0(割込み禁止)で動作するので、ホイールの
+ * 操作はシステムコールの処理とtimerdとで排他される
+ * (コールバック関数の実行中は割込み禁止なので、処理は短くすること)
+ */
+
+#define KZTIMER_NUM 8 // タイマの個数
+#define KZTIMER_WHEEL_BITS 4
+#define KZTIMER_WHEEL_SIZE (1 << KZTIMER_WHEEL_BITS) // 1レベルあたりのスロット数
+#define KZTIMER_WHEEL_MASK (KZTIMER_WHEEL_SIZE - 1)
+#define KZTIMER_WHEEL_LEVEL 3 // レベル数
+
+/* タイマ */
+typedef struct _kztimer {
+  struct _kztimer *next;
+  struct _kztimer **prevp; // 前の要素の next ポインタ(繋がれていなければ NULL)
+  uint32 expire; // 満了時刻(ティック数)
+  uint32 interval; // 周期(ティック数、ワンショットなら0)
+  kz_timer_func_t func; // コールバック関数
+  void *arg; // コールバック関数に渡す引数
+  int used;
+  /* 構造体のサイズを2の累乗にするためのダミーメンバー(kozos.c の kz_msgbox を参照) */
+  int dummy[3];
+} kztimer;
+
+static kztimer timers[KZTIMER_NUM];
+static kztimer *wheel[KZTIMER_WHEEL_LEVEL][KZTIMER_WHEEL_SIZE];
+static kztimer *expired; // 満了してコールバック待ちのタイマ
+static kztimer *pending; // ホイールが時刻に追いついてから繋ぐタイマ
+static volatile uint32 now_tick; // 現在時刻(割込みハンドラで更新)
+static uint32 wheel_tick; // ホイールの処理が済んだ時刻(timerd で更新)
+static kz_thread_id_t timerd_id; // タイマスレッド
+
+/* リストへの接続 */
+static void timer_link(kztimer **headp, kztimer *tp) {
+  tp->next = *headp;
+  if (tp->next) {
+    tp->next->prevp = &tp->next;
+  }
+  *headp = tp;
+  tp->prevp = headp;
+}
+
+/* リストからの切り離し */
+static void timer_unlink(kztimer *tp) {
+  if (tp->prevp) {
+    *(tp->prevp) = tp->next;
+    if (tp->next) {
+      tp->next->prevp = tp->prevp;
+    }
+    tp->next = NULL;
+    tp->prevp = NULL;
+  }
+}
+
+/*
+ * 満了時刻に応じたスロットにタイマを繋ぐ
+ * スロットは wheel_tick からの差で選ぶ。next はレベル0でまだ処理していない
+ * 最初の時刻で、満了時刻を過ぎているタイマはその時刻のスロットに繋ぐ
+ * (カスケード中は wheel_tick のスロットをこれから処理するので wheel_tick、
+ * それ以外は wheel_tick + 1 となる)
+ */
+static void timer_insert(kztimer *tp, uint32 next) {
+  long delta = tp->expire - wheel_tick;
+  uint32 t = tp->expire;
+  int level;
+
+  if ((long)(tp->expire - next) < 0) {
+    t = next;
+    level = 0;
+  } else if (delta < (1L << KZTIMER_WHEEL_BITS)) {
+    level = 0;
+  } else if (delta < (1L << (KZTIMER_WHEEL_BITS * 2))) {
+    level = 1;
+  } else {
+    if (delta >= (1L << (KZTIMER_WHEEL_BITS * 3))) {
+      // ホイールの範囲を超える場合は最上位レベルの最も遠いスロットに繋ぎ、カスケード時に繋ぎ直す
+      t = wheel_tick + (1L << (KZTIMER_WHEEL_BITS * 3)) - 1;
+    }
+    level = 2;
+  }
+
+  t >>= KZTIMER_WHEEL_BITS * level;
+  timer_link(&wheel[level][t & KZTIMER_WHEEL_MASK], tp);
+}
+
+/* 上位レベルのスロットのタイマを繋ぎ直す */
+static void timer_cascade(int level) {
+  kztimer *tp, *list;
+  int index = (wheel_tick >> (KZTIMER_WHEEL_BITS * level)) & KZTIMER_WHEEL_MASK;
+
+  list = wheel[level][index];
+  wheel[level][index] = NULL;
+  while (list) {
+    tp = list;
+    list = tp->next;
+    tp->next = NULL;
+    tp->prevp = NULL;
+    timer_insert(tp, wheel_tick);
+  }
+}
+
+/* 1ティック分ホイールを進めて、満了したタイマのコールバックを呼ぶ */
+static void timer_advance(void) {
+  kztimer *tp;
+  int index;
+
+  wheel_tick++;
+
+  if (!(wheel_tick & KZTIMER_WHEEL_MASK)) {
+    if (!((wheel_tick >> KZTIMER_WHEEL_BITS) & KZTIMER_WHEEL_MASK)) {
+      timer_cascade(2);
+    }
+    timer_cascade(1);
+  }
+
+  /* 満了したタイマを満了リストに移す */
+  index = wheel_tick & KZTIMER_WHEEL_MASK;
+  expired = wheel[0][index];
+  wheel[0][index] = NULL;
+  if (expired) {
+    expired->prevp = &expired;
+  }
+
+  /*
+   * コールバック中にタイマが停止される場合があるので、満了リストから
+   * 1つずつ取り出して処理する
+   */
+  while (expired) {
+    tp = expired;
+    timer_unlink(tp);
+    if (tp->interval) {
+      // 周期タイマは満了時刻を周期分進めて繋ぎ直す
+      tp->expire += tp->interval;
+      timer_insert(tp, wheel_tick + 1);
+    }
+    tp->func(tp->arg);
+  }
+}
+
+/* タイマIDの検査 */
+static kztimer *timer_get(kz_timer_id_t id) {
+  kztimer *tp = (kztimer *)id;
+  if ((tp < &timers[0]) || (tp >= &timers[KZTIMER_NUM])) {
+    return NULL;
+  }
+  if ((((char *)tp - (char *)timers) & (sizeof(*tp) - 1)) || !tp->used) {
+    return NULL;
+  }
+  return tp;
+}
+
+/* ソフトウェアタイマの初期化 */
+int kztimer_init(void) {
+  memset(timers, 0, sizeof(timers));
+  memset(wheel, 0, sizeof(wheel));
+  expired = NULL;
+  pending = NULL;
+  now_tick = 0;
+  wheel_tick = 0;
+  timerd_id = 0;
+  return 0;
+}
+
+/* タイマの生成 */
+kz_timer_id_t kztimer_create(kz_timer_func_t func, void *arg) {
+  int i;
+  kztimer *tp;
+
+  for (i = 0; i < KZTIMER_NUM; i++) {
+    tp = &timers[i];
+    if (!tp->used) {
+      memset(tp, 0, sizeof(*tp));
+      tp->used = 1;
+      tp->func = func;
+      tp->arg = arg;
+      return (kz_timer_id_t)tp;
+    }
+  }
+
+  return -1;
+}
+
+/* タイマの開始(interval が0以外なら周期タイマ) */
+int kztimer_start(kz_timer_id_t id, int msec, int interval) {
+  kztimer *tp = timer_get(id);
+
+  if (!tp || (msec <= 0) || (interval < 0)) {
+    return -1;
+  }
+
+  /* システムティックは1ミリ秒なので、ティック数はミリ秒と同じになる */
+  timer_unlink(tp);
+  tp->expire = now_tick + msec;
+  tp->interval = interval;
+
+  /*
+   * スロットは wheel_tick を基準に選ぶので、timerd がまだ時刻に追いついて
+   * いない(起床されなかったティックがある)場合は、追いついてから繋ぐ
+   */
+  if (wheel_tick != now_tick) {
+    timer_link(&pending, tp);
+  } else {
+    timer_insert(tp, wheel_tick + 1);
+  }
+
+  return 0;
+}
+
+/* タイマの停止 */
+int kztimer_stop(kz_timer_id_t id) {
+  kztimer *tp = timer_get(id);
+
+  if (!tp) {
+    return -1;
+  }
+  timer_unlink(tp);
+
+  return 0;
+}
+
+/*
+ * システムティックごとの処理(割込みハンドラから呼ぶ)
+ * 時刻を進めて、満了かカスケードの処理が必要なスロットにタイマが
+ * ある場合と、ホイールに繋ぐのを待っているタイマがある場合のみ
+ * タイマスレッドを起床させる
+ * (起床させた場合は、レディー状態のスレッドが変化するので1を返す)
+ */
+int kztimer_intr(void) {
+  uint32 t = ++now_tick;
+
+  if (!timerd_id) {
+    return 0;
+  }
+
+  if (!pending && !wheel[0][t & KZTIMER_WHEEL_MASK]) {
+    if (t & KZTIMER_WHEEL_MASK) {
+      return 0;
+    }
+    if (!wheel[1][(t >> KZTIMER_WHEEL_BITS) & KZTIMER_WHEEL_MASK] &&
+        ((t & ((1 << (KZTIMER_WHEEL_BITS * 2)) - 1)) ||
+         !wheel[2][(t >> (KZTIMER_WHEEL_BITS * 2)) & KZTIMER_WHEEL_MASK])) {
+      return 0;
+    }
+  }
+
+  kx_wakeup(timerd_id);
+  return 1;
+}
+
+/* 開始を待っていたタイマをホイールに繋ぐ(ホイールが時刻に追いついてから呼ぶ) */
+static void timer_flush(void) {
+  kztimer *tp;
+
+  while (pending) {
+    tp = pending;
+    timer_unlink(tp);
+    timer_insert(tp, wheel_tick + 1);
+  }
+}
+
+/* タイマスレッド */
+int timerd_main(int argc, char *argv[]) {
+  timerd_id = kz_getid();
+
+  while (1) {
+    /*
+     * 優先度0のスレッドは割込み禁止で動作するので、処理中に now_tick が
+     * 進むことはない。起床されなかったティックの分も含めて追いつく
+     * 開始を待っていたタイマは、現在のティックを処理する前に繋ぐ
+     * (開始した時刻は now_tick - 1 以前で、満了時刻は now_tick 以降となる)
+     */
+    while (wheel_tick != now_tick) {
+      if (wheel_tick + 1 == now_tick) {
+        timer_flush();
+      }
+      timer_advance();
+    }
+    timer_flush(); // コールバック関数の中で開始されたタイマ
+    kz_sleep();
+  }
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _KOZOS_SWTIMER_H_INCLUDED_
+#define _KOZOS_SWTIMER_H_INCLUDED_
+
+#include "defines.h"
+
+int kztimer_init(void); // ソフトウェアタイマの初期化
+kz_timer_id_t kztimer_create(kz_timer_func_t func, void *arg); // タイマの生成
+int kztimer_start(kz_timer_id_t id, int msec, int interval); // タイマの開始
+int kztimer_stop(kz_timer_id_t id); // タイマの停止
+int kztimer_intr(void); // システムティックごとの処理(割込みハンドラから呼ぶ)
+
+#endif
@@ -39,9 +39,8 @@ int kz_wakeup(kz_thread_id_t id) {
 }
 
 kz_thread_id_t kz_getid(void) {
-  kz_syscall_param_t param;
-  kz_syscall(KZ_SYSCALL_TYPE_GETID, &param);
-  return param.un.getid.ret;
+  // カーネル情報ブロックを読むだけなので、システムコールは発行しない
+  return kz_kinfo->current;
 }
 
 int kz_chpri(int priority) {
@@ -74,6 +73,125 @@ int kz_send(kz_msgbox_id_t id, int size, char *p) {
   return param.un.send.ret;
 }
 
+int kz_trysend(kz_msgbox_id_t id, int size, char *p) {
+  kz_syscall_param_t param;
+  param.un.send.id = id;
+  param.un.send.size = size;
+  param.un.send.p = p;
+  kz_syscall(KZ_SYSCALL_TYPE_TRYSEND, &param);
+  return param.un.send.ret;
+}
+
+#if KZ_CONFIG_USE_MSGPRI
+int kz_sendpri(kz_msgbox_id_t id, int size, char *p, int priority) {
+  kz_syscall_param_t param;
+  param.un.sendpri.id = id;
+  param.un.sendpri.size = size;
+  param.un.sendpri.p = p;
+  param.un.sendpri.priority = priority;
+  kz_syscall(KZ_SYSCALL_TYPE_SENDPRI, &param);
+  return param.un.sendpri.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_RING
+int kz_ring_wait(kz_ring_id_t id, int want) {
+  kz_syscall_param_t param;
+  param.un.ringwait.id = id;
+  param.un.ringwait.want = want;
+  kz_syscall(KZ_SYSCALL_TYPE_RINGWAIT, &param);
+  return param.un.ringwait.ret;
+}
+
+int kz_ring_write(kz_ring_id_t id, int size, char *p) {
+  kz_syscall_param_t param;
+  param.un.ringwrite.id = id;
+  param.un.ringwrite.size = size;
+  param.un.ringwrite.p = p;
+  kz_syscall(KZ_SYSCALL_TYPE_RINGWRITE, &param);
+  return param.un.ringwrite.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_MSGBOX_DYNAMIC
+kz_msgbox_id_t kz_msgbox_create(int limit) {
+  kz_syscall_param_t param;
+  param.un.msgbox_create.limit = limit;
+  kz_syscall(KZ_SYSCALL_TYPE_MSGBOX_CREATE, &param);
+  return param.un.msgbox_create.ret;
+}
+
+int kz_msgbox_destroy(kz_msgbox_id_t id) {
+  kz_syscall_param_t param;
+  param.un.msgbox_destroy.id = id;
+  kz_syscall(KZ_SYSCALL_TYPE_MSGBOX_DESTROY, &param);
+  return param.un.msgbox_destroy.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_SENDV
+int kz_sendv(kz_msgbox_id_t id, kz_iovec_t *iov, int iovcnt) {
+  kz_syscall_param_t param;
+  param.un.sendv.id = id;
+  param.un.sendv.iovcnt = iovcnt;
+  param.un.sendv.iov = iov;
+  kz_syscall(KZ_SYSCALL_TYPE_SENDV, &param);
+  return param.un.sendv.ret;
+}
+
+kz_thread_id_t kz_recvv(kz_msgbox_id_t id, kz_iovec_t *iov, int *iovcntp, char **pp) {
+  kz_syscall_param_t param;
+  param.un.recvv.id = id;
+  param.un.recvv.iovcntp = iovcntp;
+  param.un.recvv.pp = pp;
+  param.un.recvv.iov = iov;
+  kz_syscall(KZ_SYSCALL_TYPE_RECVV, &param);
+  return param.un.recvv.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_CALL
+int kz_call(kz_msgbox_id_t id, int size, char *p, int *rsizep, char **rpp) {
+  kz_syscall_param_t param;
+  param.un.call.id = id;
+  param.un.call.size = size;
+  param.un.call.p = p;
+  param.un.call.rsizep = rsizep;
+  param.un.call.rpp = rpp;
+  kz_syscall(KZ_SYSCALL_TYPE_CALL, &param);
+  return param.un.call.ret;
+}
+
+int kz_reply(kz_thread_id_t id, int size, char *p) {
+  kz_syscall_param_t param;
+  param.un.reply.id = id;
+  param.un.reply.size = size;
+  param.un.reply.p = p;
+  kz_syscall(KZ_SYSCALL_TYPE_REPLY, &param);
+  return param.un.reply.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_INBOX
+int kz_send_thread(kz_thread_id_t id, int size, char *p) {
+  kz_syscall_param_t param;
+  param.un.send_thread.id = id;
+  param.un.send_thread.size = size;
+  param.un.send_thread.p = p;
+  kz_syscall(KZ_SYSCALL_TYPE_SEND_THREAD, &param);
+  return param.un.send_thread.ret;
+}
+
+kz_thread_id_t kz_recv_self(int *sizep, char **pp) {
+  kz_syscall_param_t param;
+  param.un.recv.id = MSGBOX_ID_NONE;
+  param.un.recv.sizep = sizep;
+  param.un.recv.pp = pp;
+  kz_syscall(KZ_SYSCALL_TYPE_RECV_SELF, &param);
+  return param.un.recv.ret;
+}
+#endif
+
 kz_thread_id_t kz_recv(kz_msgbox_id_t id, int *sizep, char **pp) {
   kz_syscall_param_t param;
   param.un.recv.id = id;
@@ -87,10 +205,236 @@ int kz_setintr(softvec_type_t type, kz_handler_t handler) {
   kz_syscall_param_t param;
   param.un.setintr.type = type;
   param.un.setintr.handler = handler;
+  param.un.setintr.fasthandler = NULL;
+  kz_syscall(KZ_SYSCALL_TYPE_SETINTR, &param);
+  return param.un.setintr.ret;
+}
+
+int kz_setintr_fast(softvec_type_t type, kz_fasthandler_t handler) {
+  kz_syscall_param_t param;
+  param.un.setintr.type = type;
+  param.un.setintr.handler = NULL;
+  param.un.setintr.fasthandler = handler;
   kz_syscall(KZ_SYSCALL_TYPE_SETINTR, &param);
   return param.un.setintr.ret;
 }
 
+#if KZ_CONFIG_USE_WORKPOOL
+int kz_job_post(kz_job_func_t func, void *arg, kz_msgbox_id_t notify) {
+  kz_syscall_param_t param;
+  param.un.jobpost.func = func;
+  param.un.jobpost.arg = arg;
+  param.un.jobpost.notify = notify;
+  kz_syscall(KZ_SYSCALL_TYPE_JOBPOST, &param);
+  return param.un.jobpost.ret;
+}
+
+int kz_job_get(kz_job_t *job) {
+  kz_syscall_param_t param;
+  param.un.jobget.job = job;
+  kz_syscall(KZ_SYSCALL_TYPE_JOBGET, &param);
+  return param.un.jobget.ret;
+}
+
+int kz_job_done(kz_job_t *job, int result) {
+  kz_syscall_param_t param;
+  param.un.jobdone.job = job;
+  param.un.jobdone.result = result;
+  kz_syscall(KZ_SYSCALL_TYPE_JOBDONE, &param);
+  return param.un.jobdone.ret;
+}
+
+#if KZ_CONFIG_USE_STATISTICS
+int kz_job_stat(kz_jobstat_t *stat) {
+  kz_syscall_param_t param;
+  param.un.jobstat.stat = stat;
+  kz_syscall(KZ_SYSCALL_TYPE_JOBSTAT, &param);
+  return param.un.jobstat.ret;
+}
+#endif
+#endif
+
+#if KZ_CONFIG_USE_PERIODIC
+int kz_setperiod(int msec) {
+  kz_syscall_param_t param;
+  param.un.setperiod.msec = msec;
+  kz_syscall(KZ_SYSCALL_TYPE_SETPERIOD, &param);
+  return param.un.setperiod.ret;
+}
+
+int kz_wait_next_period(void) {
+  kz_syscall_param_t param;
+  kz_syscall(KZ_SYSCALL_TYPE_WAITPERIOD, &param);
+  return param.un.waitperiod.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_STATISTICS
+int kz_thread_stat(int index, kz_thread_stat_t *stat) {
+  kz_syscall_param_t param;
+  param.un.threadstat.index = index;
+  param.un.threadstat.stat = stat;
+  kz_syscall(KZ_SYSCALL_TYPE_THREADSTAT, &param);
+  return param.un.threadstat.ret;
+}
+
+int kz_msgbox_stat(int index, kz_msgbox_stat_t *stat) {
+  kz_syscall_param_t param;
+  param.un.msgboxstat.index = index;
+  param.un.msgboxstat.stat = stat;
+  kz_syscall(KZ_SYSCALL_TYPE_MSGBOXSTAT, &param);
+  return param.un.msgboxstat.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_PIPE
+kz_pipe_id_t kz_pipe_create(void) {
+  kz_syscall_param_t param;
+  kz_syscall(KZ_SYSCALL_TYPE_PIPE_CREATE, &param);
+  return param.un.pipe_create.ret;
+}
+
+int kz_pipe_destroy(kz_pipe_id_t id) {
+  kz_syscall_param_t param;
+  param.un.pipe_destroy.id = id;
+  kz_syscall(KZ_SYSCALL_TYPE_PIPE_DESTROY, &param);
+  return param.un.pipe_destroy.ret;
+}
+
+int kz_pipe_read(kz_pipe_id_t id, char *p, int size, int block) {
+  kz_syscall_param_t param;
+  param.un.pipe_rw.id = id;
+  param.un.pipe_rw.size = size;
+  param.un.pipe_rw.p = p;
+  param.un.pipe_rw.block = block;
+  kz_syscall(KZ_SYSCALL_TYPE_PIPE_READ, &param);
+  return param.un.pipe_rw.ret;
+}
+
+int kz_pipe_write(kz_pipe_id_t id, char *p, int size, int block) {
+  kz_syscall_param_t param;
+  param.un.pipe_rw.id = id;
+  param.un.pipe_rw.size = size;
+  param.un.pipe_rw.p = p;
+  param.un.pipe_rw.block = block;
+  param.un.pipe_rw.done = 0;
+  kz_syscall(KZ_SYSCALL_TYPE_PIPE_WRITE, &param);
+  return param.un.pipe_rw.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_TOPIC
+kz_topic_id_t kz_topic_create(void) {
+  kz_syscall_param_t param;
+  kz_syscall(KZ_SYSCALL_TYPE_TOPIC_CREATE, &param);
+  return param.un.topic_create.ret;
+}
+
+int kz_topic_subscribe(kz_topic_id_t id, kz_msgbox_id_t mbox) {
+  kz_syscall_param_t param;
+  param.un.topic_subscribe.id = id;
+  param.un.topic_subscribe.mbox = mbox;
+  kz_syscall(KZ_SYSCALL_TYPE_TOPIC_SUBSCRIBE, &param);
+  return param.un.topic_subscribe.ret;
+}
+
+int kz_topic_unsubscribe(kz_topic_id_t id, kz_msgbox_id_t mbox) {
+  kz_syscall_param_t param;
+  param.un.topic_subscribe.id = id;
+  param.un.topic_subscribe.mbox = mbox;
+  kz_syscall(KZ_SYSCALL_TYPE_TOPIC_UNSUBSCRIBE, &param);
+  return param.un.topic_subscribe.ret;
+}
+
+int kz_topic_publish(kz_topic_id_t id, int size, char *p) {
+  kz_syscall_param_t param;
+  param.un.topic_publish.id = id;
+  param.un.topic_publish.size = size;
+  param.un.topic_publish.p = p;
+  kz_syscall(KZ_SYSCALL_TYPE_TOPIC_PUBLISH, &param);
+  return param.un.topic_publish.ret;
+}
+
+int kz_topic_release(char *p) {
+  kz_syscall_param_t param;
+  param.un.topic_release.p = p;
+  kz_syscall(KZ_SYSCALL_TYPE_TOPIC_RELEASE, &param);
+  return param.un.topic_release.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_SWTIMER
+kz_timer_id_t kz_timer_create(kz_timer_func_t func, void *arg) {
+  kz_syscall_param_t param;
+  param.un.timercreate.func = func;
+  param.un.timercreate.arg = arg;
+  kz_syscall(KZ_SYSCALL_TYPE_TIMERCREATE, &param);
+  return param.un.timercreate.ret;
+}
+
+int kz_timer_start(kz_timer_id_t id, int msec, int interval) {
+  kz_syscall_param_t param;
+  param.un.timerstart.id = id;
+  param.un.timerstart.msec = msec;
+  param.un.timerstart.interval = interval;
+  kz_syscall(KZ_SYSCALL_TYPE_TIMERSTART, &param);
+  return param.un.timerstart.ret;
+}
+
+int kz_timer_stop(kz_timer_id_t id) {
+  kz_syscall_param_t param;
+  param.un.timerstop.id = id;
+  kz_syscall(KZ_SYSCALL_TYPE_TIMERSTOP, &param);
+  return param.un.timerstop.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_BUDGET
+int kz_setbudget(uint32 budget_usec, int msec) {
+  kz_syscall_param_t param;
+  param.un.setbudget.budget = budget_usec;
+  param.un.setbudget.msec = msec;
+  kz_syscall(KZ_SYSCALL_TYPE_SETBUDGET, &param);
+  return param.un.setbudget.ret;
+}
+#endif
+
+#if KZ_CONFIG_USE_BATCH
+int kz_batch(kz_batch_t *ops, int num) {
+  kz_syscall_param_t param;
+  param.un.batch.ops = ops;
+  param.un.batch.num = num;
+  kz_syscall(KZ_SYSCALL_TYPE_BATCH, &param);
+  return param.un.batch.ret;
+}
+
+/* メッセージを送信して、応答を受信する(1回のシステムコールで行う) */
+kz_thread_id_t kz_sendrecv(kz_msgbox_id_t sid, int size, char *p, kz_msgbox_id_t rid, int *sizep, char **pp) {
+  kz_batch_t ops[2];
+  ops[0].type = KZ_SYSCALL_TYPE_SEND;
+  ops[0].param.un.send.id = sid;
+  ops[0].param.un.send.size = size;
+  ops[0].param.un.send.p = p;
+  ops[1].type = KZ_SYSCALL_TYPE_RECV;
+  ops[1].param.un.recv.id = rid;
+  ops[1].param.un.recv.sizep = sizep;
+  ops[1].param.un.recv.pp = pp;
+  switch (kz_batch(ops, 2)) {
+    case 2:
+      return ops[1].param.un.recv.ret;
+    case 1:
+      // 送信に失敗した場合は、応答は来ないので受信しない
+      if (ops[0].param.un.send.ret < 0) {
+        return -1;
+      }
+      // 送信でブロックした場合は、受信は別に行う
+      return kz_recv(rid, sizep, pp);
+    default:
+      return -1;
+  }
+}
+#endif
+
 /* サービスコール */
 int kx_wakeup(kz_thread_id_t id) {
   kz_syscall_param_t param;
@@ -121,3 +465,14 @@ int kx_send(kz_msgbox_id_t id, int size, char *p) {
   kz_srvcall(KZ_SYSCALL_TYPE_SEND, &param);
   return param.un.send.ret;
 }
+
+#if KZ_CONFIG_USE_RING
+int kx_ring_write(kz_ring_id_t id, int size, char *p) {
+  kz_syscall_param_t param;
+  param.un.ringwrite.id = id;
+  param.un.ringwrite.size = size;
+  param.un.ringwrite.p = p;
+  kz_srvcall(KZ_SYSCALL_TYPE_RINGWRITE, &param);
+  return param.un.ringwrite.ret;
+}
+#endif
@@ -18,6 +18,41 @@ typedef enum {
   KZ_SYSCALL_TYPE_SEND,
   KZ_SYSCALL_TYPE_RECV,
   KZ_SYSCALL_TYPE_SETINTR,
+  KZ_SYSCALL_TYPE_JOBPOST,
+  KZ_SYSCALL_TYPE_JOBGET,
+  KZ_SYSCALL_TYPE_JOBDONE,
+  KZ_SYSCALL_TYPE_JOBSTAT,
+  KZ_SYSCALL_TYPE_SETPERIOD,
+  KZ_SYSCALL_TYPE_WAITPERIOD,
+  KZ_SYSCALL_TYPE_THREADSTAT,
+  KZ_SYSCALL_TYPE_TIMERCREATE,
+  KZ_SYSCALL_TYPE_TIMERSTART,
+  KZ_SYSCALL_TYPE_TIMERSTOP,
+  KZ_SYSCALL_TYPE_SETBUDGET,
+  KZ_SYSCALL_TYPE_BATCH,
+  KZ_SYSCALL_TYPE_TRYSEND,
+  KZ_SYSCALL_TYPE_CALL,
+  KZ_SYSCALL_TYPE_REPLY,
+  KZ_SYSCALL_TYPE_SENDV,
+  KZ_SYSCALL_TYPE_RECVV,
+  KZ_SYSCALL_TYPE_MSGBOX_CREATE,
+  KZ_SYSCALL_TYPE_MSGBOX_DESTROY,
+  KZ_SYSCALL_TYPE_SENDPRI,
+  KZ_SYSCALL_TYPE_TOPIC_CREATE,
+  KZ_SYSCALL_TYPE_TOPIC_SUBSCRIBE,
+  KZ_SYSCALL_TYPE_TOPIC_UNSUBSCRIBE,
+  KZ_SYSCALL_TYPE_TOPIC_PUBLISH,
+  KZ_SYSCALL_TYPE_TOPIC_RELEASE,
+  KZ_SYSCALL_TYPE_MSGBOXSTAT,
+  KZ_SYSCALL_TYPE_RINGWAIT,
+  KZ_SYSCALL_TYPE_RINGWRITE,
+  KZ_SYSCALL_TYPE_PIPE_CREATE,
+  KZ_SYSCALL_TYPE_PIPE_DESTROY,
+  KZ_SYSCALL_TYPE_PIPE_READ,
+  KZ_SYSCALL_TYPE_PIPE_WRITE,
+  KZ_SYSCALL_TYPE_SEND_THREAD,
+  KZ_SYSCALL_TYPE_RECV_SELF,
+  KZ_SYSCALL_TYPE_NUM /* システムコールの個数(構成によらず番号は固定) */
 } kz_syscall_type_t;
 
 typedef struct {
@@ -71,12 +106,208 @@ typedef struct {
       char **pp;
       kz_thread_id_t ret;
     } recv;
+#if KZ_CONFIG_USE_MSGPRI
+    struct {
+      /* 先頭は send と同じ並びにする(送信待ちからの送信で send として参照する) */
+      kz_msgbox_id_t id;
+      int size;
+      char *p;
+      int ret;
+      int priority;
+    } sendpri;
+#endif
+#if KZ_CONFIG_USE_INBOX
+    struct {
+      kz_thread_id_t id;
+      int size;
+      char *p;
+      int ret;
+    } send_thread; // kz_recv_self() は recv を使う
+#endif
+#if KZ_CONFIG_USE_SENDV
+    struct {
+      /* send と同じ並びにする(送信待ちからの送信で send として参照する) */
+      kz_msgbox_id_t id;
+      int iovcnt;
+      kz_iovec_t *iov;
+      int ret;
+    } sendv;
+    struct {
+      /* 先頭は recv と同じ並びにする(受信処理で recv として参照する) */
+      kz_msgbox_id_t id;
+      int *iovcntp;
+      char **pp;
+      kz_thread_id_t ret;
+      kz_iovec_t *iov;
+    } recvv;
+#endif
+#if KZ_CONFIG_USE_CALL
+    struct {
+      /* 先頭は send と同じ並びにする(送信待ちからの送信で send として参照する) */
+      kz_msgbox_id_t id;
+      int size;
+      char *p;
+      int ret;
+      int *rsizep;
+      char **rpp;
+    } call;
+    struct {
+      kz_thread_id_t id;
+      int size;
+      char *p;
+      int ret;
+    } reply;
+#endif
+#if KZ_CONFIG_USE_RING
+    struct {
+      kz_ring_id_t id;
+      int want;
+      int ret;
+    } ringwait;
+    struct {
+      kz_ring_id_t id;
+      int size;
+      char *p;
+      int ret;
+    } ringwrite;
+#endif
+#if KZ_CONFIG_USE_MSGBOX_DYNAMIC
+    struct {
+      int limit;
+      kz_msgbox_id_t ret;
+    } msgbox_create;
+    struct {
+      kz_msgbox_id_t id;
+      int ret;
+    } msgbox_destroy;
+#endif
     struct {
       softvec_type_t type;
       kz_handler_t handler;
+      kz_fasthandler_t fasthandler;
       int ret;
     } setintr;
+#if KZ_CONFIG_USE_BATCH
+    struct {
+      struct _kz_batch *ops;
+      int num;
+      int ret;
+    } batch;
+#endif
+#if KZ_CONFIG_USE_WORKPOOL
+    struct {
+      kz_job_func_t func;
+      void *arg;
+      kz_msgbox_id_t notify;
+      int ret;
+    } jobpost;
+    struct {
+      kz_job_t *job;
+      int ret;
+    } jobget;
+    struct {
+      kz_job_t *job;
+      int result;
+      int ret;
+    } jobdone;
+#if KZ_CONFIG_USE_STATISTICS
+    struct {
+      kz_jobstat_t *stat;
+      int ret;
+    } jobstat;
+#endif
+#endif
+#if KZ_CONFIG_USE_PERIODIC
+    struct {
+      int msec;
+      int ret;
+    } setperiod;
+    struct {
+      int ret;
+    } waitperiod;
+#endif
+#if KZ_CONFIG_USE_STATISTICS
+    struct {
+      int index;
+      kz_thread_stat_t *stat;
+      int ret;
+    } threadstat;
+    struct {
+      int index;
+      kz_msgbox_stat_t *stat;
+      int ret;
+    } msgboxstat;
+#endif
+#if KZ_CONFIG_USE_SWTIMER
+    struct {
+      kz_timer_func_t func;
+      void *arg;
+      kz_timer_id_t ret;
+    } timercreate;
+    struct {
+      kz_timer_id_t id;
+      int msec;
+      int interval;
+      int ret;
+    } timerstart;
+    struct {
+      kz_timer_id_t id;
+      int ret;
+    } timerstop;
+#endif
+#if KZ_CONFIG_USE_BUDGET
+    struct {
+      uint32 budget;
+      int msec;
+      int ret;
+    } setbudget;
+#endif
+#if KZ_CONFIG_USE_PIPE
+    struct {
+      kz_pipe_id_t ret;
+    } pipe_create;
+    struct {
+      kz_pipe_id_t id;
+      int ret;
+    } pipe_destroy;
+    struct {
+      kz_pipe_id_t id;
+      int size; // 書き込みでブロックした場合は、残りのサイズに更新される
+      char *p; // 書き込みでブロックした場合は、残りのデータの先頭に更新される
+      int ret;
+      int block;
+      int done; // 書き込み済みのサイズ
+    } pipe_rw; // kz_pipe_read(), kz_pipe_write() で共用する
+#endif
+#if KZ_CONFIG_USE_TOPIC
+    struct {
+      kz_topic_id_t ret;
+    } topic_create;
+    struct {
+      kz_topic_id_t id;
+      kz_msgbox_id_t mbox;
+      int ret;
+    } topic_subscribe; // kz_topic_unsubscribe() でも使う
+    struct {
+      kz_topic_id_t id;
+      int size;
+      char *p;
+      int ret;
+    } topic_publish;
+    struct {
+      char *p;
+      int ret;
+    } topic_release;
+#endif
   } un;
 } kz_syscall_param_t;
 
+#if KZ_CONFIG_USE_BATCH
+/* kz_batch() で一括して発行するシステムコール */
+typedef struct _kz_batch {
+  kz_syscall_type_t type;
+  kz_syscall_param_t param; // 引数と戻り値(ブロックした場合の戻り値は、起床時に格納される)
+} kz_batch_t;
+#endif
+
 #endif
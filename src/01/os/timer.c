@@ -0,0 +1,78 @@
+#include "defines.h"
+#include "timer.h"
+
+/*
+ * 16ビットタイマのチャネル0をシステムティック用のタイマとして利用する
+ * φ/4 のクロックでカウントし、GRA とのコンペアマッチでカウンタを
+ * クリアすることで、TIMER_TICK_USEC ごとに割込みを発生させる
+ */
+
+#define H8_3069F_TMR16 ((volatile struct h8_3069f_tmr16 *)0xffff60)
+#define H8_3069F_TMR16_CH0 ((volatile struct h8_3069f_tmr16_ch *)0xffff68)
+
+struct h8_3069f_tmr16 {
+  volatile uint8 tstr;
+  volatile uint8 tsnc;
+  volatile uint8 tmdr;
+  volatile uint8 tolr;
+  volatile uint8 tisra;
+  volatile uint8 tisrb;
+  volatile uint8 tisrc;
+};
+
+struct h8_3069f_tmr16_ch {
+  volatile uint8 tcr;
+  volatile uint8 tior;
+  volatile uint16 tcnt;
+  volatile uint16 gra;
+  volatile uint16 grb;
+};
+
+#define H8_3069F_TMR16_TSTR_STR0 (1<<0)
+
+#define H8_3069F_TMR16_TISRA_IMFA0 (1<<0)
+#define H8_3069F_TMR16_TISRA_IMIEA0 (1<<4)
+
+#define H8_3069F_TMR16_TCR_TPSC_PER1 (0<<0)
+#define H8_3069F_TMR16_TCR_TPSC_PER2 (1<<0)
+#define H8_3069F_TMR16_TCR_TPSC_PER4 (2<<0)
+#define H8_3069F_TMR16_TCR_TPSC_PER8 (3<<0)
+#define H8_3069F_TMR16_TCR_CCLR_GRA (1<<5) /* GRA のコンペアマッチでクリア */
+
+/* 周期割込みの開始 */
+int timer_start(void) {
+  volatile struct h8_3069f_tmr16 *tmr = H8_3069F_TMR16;
+  volatile struct h8_3069f_tmr16_ch *tmr0 = H8_3069F_TMR16_CH0;
+
+  tmr->tstr &= ~H8_3069F_TMR16_TSTR_STR0; /* カウント停止 */
+
+  tmr0->tcr = H8_3069F_TMR16_TCR_CCLR_GRA | H8_3069F_TMR16_TCR_TPSC_PER4;
+  tmr0->tior = 0;
+  tmr0->tcnt = 0;
+  tmr0->gra = TIMER_TICK_COUNT - 1;
+
+  tmr->tisra &= ~H8_3069F_TMR16_TISRA_IMFA0;
+  tmr->tisra |= H8_3069F_TMR16_TISRA_IMIEA0; /* コンペアマッチ割込み有効 */
+
+  tmr->tstr |= H8_3069F_TMR16_TSTR_STR0; /* カウント開始 */
+
+  return 0;
+}
+
+/* 周期が満了したか？ */
+int timer_is_expired(void) {
+  volatile struct h8_3069f_tmr16 *tmr = H8_3069F_TMR16;
+  return (tmr->tisra & H8_3069F_TMR16_TISRA_IMFA0) ? 1 : 0;
+}
+
+/* 周期の満了を通知(割込み要因のクリア) */
+void timer_expire(void) {
+  volatile struct h8_3069f_tmr16 *tmr = H8_3069F_TMR16;
+  tmr->tisra &= ~H8_3069F_TMR16_TISRA_IMFA0;
+}
+
+/* カウンタ値の取得 */
+unsigned int timer_get_count(void) {
+  volatile struct h8_3069f_tmr16_ch *tmr0 = H8_3069F_TMR16_CH0;
+  return tmr0->tcnt;
+}
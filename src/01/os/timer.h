@@ -0,0 +1,13 @@
+#ifndef _TIMER_H_INCLUDED_
+#define _TIMER_H_INCLUDED_
+
+#define TIMER_CLOCK_PER_USEC 5 // 1マイクロ秒あたりのカウント数(20MHz / 4 = 5MHz)
+#define TIMER_TICK_USEC 1000 // システムティックの周期(1ミリ秒)
+#define TIMER_TICK_COUNT (TIMER_CLOCK_PER_USEC * TIMER_TICK_USEC) // 1ティックのカウント数
+
+int timer_start(void); /* 周期割込みの開始 */
+int timer_is_expired(void); /* 周期が満了したか？ */
+void timer_expire(void); /* 周期の満了を通知(割込み要因のクリア) */
+unsigned int timer_get_count(void); /* カウンタ値の取得 */
+
+#endif
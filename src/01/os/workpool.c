@@ -0,0 +1,37 @@
+#include "defines.h"
+#include "kozos.h"
+#include "lib.h"
+
+#if KZ_CONFIG_USE_WORKPOOL
+
+/*
+ * ワーカスレッド
+ * ジョブキューからジョブを取り出して実行し、完了を通知する処理を繰り返す
+ * (ジョブ毎にスレッドを生成しないので、スタックの消費やスレッド生成の
+ * コストはワーカスレッドの起動時のみとなる)
+ */
+int workpool_main(int argc, char *argv[]) {
+  kz_job_t job;
+  int result;
+
+  while (1) {
+    kz_job_get(&job); // ジョブがなければブロックする
+    result = job.func(job.arg);
+    kz_job_done(&job, result);
+  }
+
+  return 0;
+}
+
+/* ワーカスレッドプールを起動する */
+int kz_workpool_start(int num, int priority, int stacksize) {
+  int i;
+  for (i = 0; i < num; i++) {
+    if (kz_run(workpool_main, "worker", priority, stacksize, 0, NULL) == (kz_thread_id_t)-1) {
+      break;
+    }
+  }
+  return i;
+}
+
+#endif
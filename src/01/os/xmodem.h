@@ -0,0 +1,6 @@
+#ifndef _XMODEM_H_INCLUDED_
+#define _XMODEM_H_INCLUDED_
+
+long xmodem_recv(char *buf, long max);
+
+#endif